@@ -50,6 +50,7 @@
 #include "filehdr.h"
 #include "filesys.h"
 #include "synch.h"
+#include "system.h"
 
 // Sectors containing the file headers for the bitmap of free sectors,
 // and the directory of files.  These file headers are placed in well-known 
@@ -63,21 +64,6 @@
 #define FreeMapFileSize 	(NumSectors / BitsInByte)
 
 
-// The following arrays are indexed with the sector of the file header.
-// Since the # of files in system cannot exceed NumSectors, we set the length of 
-// this array as this number.
-int of_cnt[NumSectors] = {0}; // record how many OpenFile objects are 
-                    // associated with each file.
-                    // The counter gets inc every time OpenFile::OpenFile is invoked,
-                    // and gets dec every time OpenFile::~OpenFile is invoked.
-FileHeader *hdrs[NumSectors] = {NULL}; // system open file header
-Lock hdrs_lock("hdrs_lock"); // for exclusion access to "hdrs" and "of_cnt"
-
-Semaphore *rw_sem[NumSectors] = {NULL}; // Semaphores used to synchronize read/write 
-                                    // the same file from multiple threads. 
-int fread_cnt[NumSectors] = {0}; // record # of active readers
-Lock *fread_lock[NumSectors] = {NULL}; // for exclusion access to "fread_cnt[sect]"
-
 // this lock is for exclusion calls to FileSystem::Create and FileSystem::Remove
 static Lock filesys_lock("filesys_lock");
 
@@ -207,6 +193,8 @@ bool
 FileSystem::Create(char *name, FileType type)
 {
     filesys_lock.Acquire();
+    synchDisk->HostLock();		// other processes sharing the disk
+					// (-j) wait until we are done
 
     Directory *directory;
     BitMap *freeMap;
@@ -231,6 +219,7 @@ FileSystem::Create(char *name, FileType type)
         name[i] = '\0';
         openFile = Open(name);
         if (openFile == NULL) { // path "name" is not valid
+            synchDisk->HostUnlock();
             filesys_lock.Release();        
             return FALSE;
         }
@@ -281,6 +270,7 @@ FileSystem::Create(char *name, FileType type)
     if (openFile != rootDirFile)
         delete openFile;
     
+    synchDisk->HostUnlock();
     filesys_lock.Release();        
     return success;
 }
@@ -376,6 +366,8 @@ bool
 FileSystem::Remove(char *name)
 {
     filesys_lock.Acquire();
+    synchDisk->HostLock();		// other processes sharing the disk
+					// (-j) wait until we are done
 
     Directory *directory;
     OpenFile *openFile;
@@ -398,6 +390,7 @@ FileSystem::Remove(char *name)
         name[i] = '\0';
         openFile = Open(name);
         if (openFile == NULL) { // path "name" is not valid
+            synchDisk->HostUnlock();
             filesys_lock.Release();
             return FALSE;
         }
@@ -433,7 +426,7 @@ FileSystem::Remove(char *name)
         }
 
         // check if the file is currently used by some threads
-        if (of_cnt[sector] != 0) {
+        if (OpenFile::IsOpen(sector)) {
             printf("Unable to remove the file, it is opened elsewhere!\n");
             success = FALSE;
         }
@@ -456,6 +449,7 @@ FileSystem::Remove(char *name)
     if (openFile != rootDirFile)
         delete openFile;
     
+    synchDisk->HostUnlock();
     filesys_lock.Release();
     return success;
 } 
@@ -19,17 +19,51 @@
 #include <strings.h>
 #endif
 
-extern int of_cnt[];
-extern FileHeader *hdrs[];
-extern Lock hdrs_lock;
-extern Semaphore *rw_sem[];
-extern int fread_cnt[];
-extern Lock *fread_lock[];
+// The headers of the open files, hashed by sector: only the files which
+// are open take any memory.
+static OpenHeader *openHdrs[OpenHdrBuckets];
+static Lock hdrs_lock("hdrs_lock", TRUE); // for exclusion access to 
+                    // "openHdrs" and the OpenHeader counts; adaptive: 
+                    // waiters spin through the in-memory updates, and
+                    // sleep once the holder blocks on the disk
+
+//----------------------------------------------------------------------
+// FindOpenHeader
+// 	Return the shared state of the open file whose header is at 
+//	"sector", or NULL if it is not open.  hdrs_lock must be held.
+//----------------------------------------------------------------------
+static OpenHeader *
+FindOpenHeader(int sector)
+{
+    OpenHeader *h;
+
+    for (h = openHdrs[sector % OpenHdrBuckets]; h != NULL; h = h->next)
+        if (h->sector == sector)
+            break;
+    return h;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::IsOpen
+// 	Is the file whose header is at "sector" open, e.g. by another 
+//	thread?  Then it must not be removed.
+//----------------------------------------------------------------------
+bool
+OpenFile::IsOpen(int sector)
+{
+    bool open;
+
+    hdrs_lock.Acquire();
+    open = (FindOpenHeader(sector) != NULL);
+    hdrs_lock.Release();
+    return open;
+}
 
 //----------------------------------------------------------------------
 // OpenFile::OpenFile
 // 	Open a Nachos file for reading and writing.  Bring the file header
-//	into memory while the file is open.
+//	into memory while the file is open: the first OpenFile of the file
+//	reads it, and the others share it.
 //
 //	"sector" -- the location on disk of the file header for this file
 //----------------------------------------------------------------------
@@ -39,43 +73,41 @@ OpenFile::OpenFile(int sector)
     hdrSector = sector;
 
     hdrs_lock.Acquire();
-    of_cnt[hdrSector]++;
-    if (of_cnt[hdrSector] == 1) {
-        ASSERT(hdrs[hdrSector] == NULL);
-        hdrs[hdrSector] = new FileHeader;
-        hdrs[hdrSector]->FetchFrom(hdrSector);
-
-        ASSERT(rw_sem[hdrSector] == NULL);
-        rw_sem[hdrSector] = new Semaphore("rw_sem", 1);
-
-        ASSERT(fread_cnt[hdrSector] == 0);
-        ASSERT(fread_lock[hdrSector] == NULL);
-        fread_lock[hdrSector] = new Lock("fread_lock");
+    shared = FindOpenHeader(hdrSector);
+    if (shared == NULL) {
+        OpenHeader **chain = &openHdrs[hdrSector % OpenHdrBuckets];
+
+        shared = new OpenHeader;
+        shared->sector = hdrSector;
+        shared->count = 0;
+        shared->hdr = new FileHeader;
+        shared->hdr->FetchFrom(hdrSector);
+        shared->lock = new RWLock("rw_lock");
+        shared->next = *chain;
+        *chain = shared;
     }
+    shared->count++;
     hdrs_lock.Release();
 }
 
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
 // 	Close a Nachos file, de-allocating any in-memory data structures.
+//	The last OpenFile of the file frees its header and lock.
 //----------------------------------------------------------------------
 OpenFile::~OpenFile()
 {
+    OpenHeader **p;
+
     hdrs_lock.Acquire();
-    of_cnt[hdrSector]--;
-    if (of_cnt[hdrSector] == 0) {
-        ASSERT(hdrs[hdrSector] != NULL);
-        delete hdrs[hdrSector];
-        hdrs[hdrSector] = NULL;
-
-        ASSERT(rw_sem[hdrSector] != NULL);
-        delete rw_sem[hdrSector];
-        rw_sem[hdrSector] = NULL;
-
-        ASSERT(fread_cnt[hdrSector] == 0);
-        ASSERT(fread_lock[hdrSector] != NULL);
-        delete fread_lock[hdrSector];
-        fread_lock[hdrSector] = NULL;
+    if (--shared->count == 0) {
+        for (p = &openHdrs[hdrSector % OpenHdrBuckets]; *p != shared; 
+                                                    p = &(*p)->next)
+            ASSERT(*p != NULL);
+        *p = shared->next;
+        delete shared->hdr;
+        delete shared->lock;
+        delete shared;
     }
     hdrs_lock.Release();
 }
@@ -146,33 +178,23 @@ OpenFile::Write(char *into, int numBytes)
 //	"position" -- the offset within the file of the first byte to be
 //			read/written
 //  "calledInWriteAt" -- if this func is called by OpenFile::WriteAt, then 
-//     we cannot do P,V operation since otherwise we may get a deadlock.
+//     it already holds the write lock, and taking the read lock would
+//     deadlock.
 //----------------------------------------------------------------------
 int
 OpenFile::ReadAt(char *into, int numBytes, int position, bool calledInWriteAt)
 {
     if (!calledInWriteAt) {
-        ASSERT(fread_lock[hdrSector] != NULL);
-
-        fread_lock[hdrSector]->Acquire();
-        fread_cnt[hdrSector]++;
-        if (fread_cnt[hdrSector] == 1)
-            rw_sem[hdrSector]->P();
-        fread_lock[hdrSector]->Release();
+        shared->lock->AcquireRead();
     }
 
-    int fileLength = hdrs[hdrSector]->FileLength();
+    int fileLength = shared->hdr->FileLength();
     int i, firstSector, lastSector, numSectors;
     char *buf;
 
     if ((numBytes <= 0) || (position >= fileLength)) {
-        if (!calledInWriteAt) {
-            fread_lock[hdrSector]->Acquire();
-            fread_cnt[hdrSector]--;
-            if (fread_cnt[hdrSector] == 0)
-                rw_sem[hdrSector]->V();
-            fread_lock[hdrSector]->Release();
-        }
+        if (!calledInWriteAt)
+            shared->lock->ReleaseRead();
     	return 0; 				// check request
     }
     if ((position + numBytes) > fileLength)
@@ -187,7 +209,7 @@ OpenFile::ReadAt(char *into, int numBytes, int position, bool calledInWriteAt)
     // read in all the full and partial sectors that we need
     buf = new char[numSectors * SectorSize];
     for (i = firstSector; i <= lastSector; i++)	{
-        synchDisk->ReadSector(hdrs[hdrSector]->ByteToSector(i * SectorSize), 
+        synchDisk->ReadSector(shared->hdr->ByteToSector(i * SectorSize), 
 					&buf[(i - firstSector) * SectorSize]);
     }
     // copy the part we want
@@ -196,26 +218,21 @@ OpenFile::ReadAt(char *into, int numBytes, int position, bool calledInWriteAt)
 
     // update last visited time
     hdrs_lock.Acquire();
-    getCurrTime(hdrs[hdrSector]->visit_time);
-    hdrs[hdrSector]->WriteBack(hdrSector);
+    getCurrTime(shared->hdr->visit_time);
+    shared->hdr->WriteBack(hdrSector);
     hdrs_lock.Release();
 
-    if (!calledInWriteAt) {
-        fread_lock[hdrSector]->Acquire();
-        fread_cnt[hdrSector]--;
-        if (fread_cnt[hdrSector] == 0)
-            rw_sem[hdrSector]->V();
-        fread_lock[hdrSector]->Release();
-    }
+    if (!calledInWriteAt)
+        shared->lock->ReleaseRead();
     return numBytes;
 }
 
 int
 OpenFile::WriteAt(char *from, int numBytes, int position)
 {
-    rw_sem[hdrSector]->P();
+    shared->lock->AcquireWrite();
 
-    int fileLength = hdrs[hdrSector]->FileLength();
+    int fileLength = shared->hdr->FileLength();
     int i, firstSector, lastSector, numSectors;
     bool firstAligned, lastAligned;
     char *buf;
@@ -223,15 +240,18 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
     // extend the file size if necessary
     if (position + numBytes > fileLength) {
         BitMap *freeMap = new BitMap(NumSectors);
+        synchDisk->HostLock();
         freeMap->FetchFrom(fileSystem->freeMapFile);
-        if (!hdrs[hdrSector]->IncreaseSize(freeMap, position + numBytes - fileLength)) {
+        if (!shared->hdr->IncreaseSize(freeMap, position + numBytes - fileLength)) {
             printf("Unable to extend the size of the file.\n");
+            synchDisk->HostUnlock();
             delete freeMap;
 
-            rw_sem[hdrSector]->V();
+            shared->lock->ReleaseWrite();
             return 0;
         }
         freeMap->WriteBack(fileSystem->freeMapFile); // flush changes to disk
+        synchDisk->HostUnlock();
         delete freeMap;
     }
 
@@ -256,19 +276,19 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
 
 // write modified sectors back
     for (i = firstSector; i <= lastSector; i++)	{
-        synchDisk->WriteSector(hdrs[hdrSector]->ByteToSector(i * SectorSize), 
+        synchDisk->WriteSector(shared->hdr->ByteToSector(i * SectorSize), 
 					&buf[(i - firstSector) * SectorSize]);
     }
     delete [] buf;
 
     // update last visited time and modified time
     hdrs_lock.Acquire();
-    getCurrTime(hdrs[hdrSector]->visit_time);
-    getCurrTime(hdrs[hdrSector]->modify_time);
-    hdrs[hdrSector]->WriteBack(hdrSector);
+    getCurrTime(shared->hdr->visit_time);
+    getCurrTime(shared->hdr->modify_time);
+    shared->hdr->WriteBack(hdrSector);
     hdrs_lock.Release();
 
-    rw_sem[hdrSector]->V();
+    shared->lock->ReleaseWrite();
     return numBytes;
 }
 
@@ -279,7 +299,7 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
 int
 OpenFile::Length() 
 { 
-    return hdrs[hdrSector]->FileLength(); 
+    return shared->hdr->FileLength(); 
 }
 
 //----------------------------------------------------------------------
@@ -289,5 +309,5 @@ OpenFile::Length()
 FileType
 OpenFile::getFileType()
 {
-    return hdrs[hdrSector]->type;
+    return shared->hdr->type;
 }
\ No newline at end of file
@@ -60,6 +60,25 @@ class OpenFile {
 
 #else // FILESYS
 
+class RWLock;
+
+#define OpenHdrBuckets	32	// # of hash chains of open file headers
+
+// The following class keeps what the OpenFile objects of one file 
+// share: its header, kept in memory while the file is open, and the
+// reader-writer lock which lets several threads read it at once.  It
+// exists only while the file is open, in a hash table by header sector.
+
+class OpenHeader {
+  public:
+    int sector;			// sector of the file header
+    int count;			// # of OpenFile objects of the file
+    FileHeader *hdr;		// the file header
+    RWLock *lock;		// readers share it, writers go first, so
+				// a stream of readers cannot starve them
+    OpenHeader *next;		// next in its hash chain
+};
+
 class OpenFile {
   public:
     OpenFile(int sector);		// Open a file whose header is located
@@ -87,9 +106,15 @@ class OpenFile {
 					// end of file, tell, lseek back 
 	
 	FileType getFileType(); // get the type of this file
+	int getHdrSector() { return hdrSector; } // open the same file again
+				// with "new OpenFile(getHdrSector())"
+	static bool IsOpen(int sector); // is the file whose header is at 
+				// "sector" opened anywhere?
 
   private:
 	int hdrSector; // the sector of the header file
+	OpenHeader *shared; // state shared with the other OpenFile objects
+				// of the same file
     int seekPosition;			// Current position within the file
 };
 
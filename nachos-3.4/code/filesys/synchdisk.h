@@ -42,6 +42,14 @@ class SynchDisk {
 					// handler, to signal that the
 					// current disk operation is complete.
 
+    void Share() { disk->Share(); }	// Share the disk with other Nachos
+					// processes (cf. "-j")
+    void HostLock() { disk->HostLock(); }
+    void HostUnlock() { disk->HostUnlock(); }
+					// Keep those processes off the disk,
+					// around a read-modify-write of the
+					// file system's data structures
+
   private:
     Disk *disk;		  		// Raw disk device
     Semaphore *semaphore; 		// To synchronize requesting thread 
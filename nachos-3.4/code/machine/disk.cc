@@ -50,6 +50,8 @@ Disk::Disk(char* name, VoidFunctionPtr callWhenDone, int callArg)
     handlerArg = callArg;
     lastSector = 0;
     bufferInit = 0;
+    shared = FALSE;
+    lockDepth = 0;
     
     fileno = OpenForReadWrite(name, FALSE);
     if (fileno >= 0) {		 	// file exists, check magic number 
@@ -121,8 +123,10 @@ Disk::ReadRequest(int sectorNumber, char* data)
     ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
     
     DEBUG('d', "Reading from sector %d\n", sectorNumber);
+    HostLock();
     Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
     Read(fileno, data, SectorSize);
+    HostUnlock();
     if (DebugIsEnabled('d'))
 	PrintSector(FALSE, sectorNumber, data);
     
@@ -141,8 +145,10 @@ Disk::WriteRequest(int sectorNumber, char* data)
     ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
     
     DEBUG('d', "Writing to sector %d\n", sectorNumber);
+    HostLock();
     Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
     WriteFile(fileno, data, SectorSize);
+    HostUnlock();
     if (DebugIsEnabled('d'))
 	PrintSector(TRUE, sectorNumber, data);
     
@@ -152,6 +158,30 @@ Disk::WriteRequest(int sectorNumber, char* data)
     interrupt->Schedule(DiskDone, (int) this, ticks, DiskInt);
 }
 
+//----------------------------------------------------------------------
+// Disk::HostLock/HostUnlock
+// 	When the UNIX file is shared with other Nachos processes, lock it
+//	against them.  Besides each sector transfer (whose seek and
+//	read/write must not be split, as the processes share the file
+//	offset), the file system locks the disk around its updates of
+//	the free map and directories.  Calls may nest: the file is locked
+//	by the outermost pair.
+//----------------------------------------------------------------------
+
+void
+Disk::HostLock()
+{
+    if (shared && lockDepth++ == 0)
+	LockFile(fileno);
+}
+
+void
+Disk::HostUnlock()
+{
+    if (shared && --lockDepth == 0)
+	UnlockFile(fileno);
+}
+
 //----------------------------------------------------------------------
 // Disk::HandleInterrupt()
 // 	Called when it is time to invoke the disk interrupt handler,
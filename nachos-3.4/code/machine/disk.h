@@ -75,6 +75,11 @@ class Disk {
 					// newSector will take: 
 					// (seek + rotational delay + transfer)
 
+    void Share() { shared = TRUE; }	// The UNIX file will be shared by
+					// several Nachos processes (cf. "-j")
+    void HostLock();			// Keep the other processes off the
+    void HostUnlock();			// disk; calls may nest
+
   private:
     int fileno;				// UNIX file number for simulated disk 
     VoidFunctionPtr handler;		// Interrupt handler, to be invoked 
@@ -84,6 +89,8 @@ class Disk {
     int lastSector;			// The previous disk request 
     int bufferInit;			// When the track buffer started 
 					// being loaded
+    bool shared;			// Is the UNIX file shared?
+    int lockDepth;			// # of nested HostLock calls
 
     int TimeToSeek(int newSector, int *rotate); // time to get to the new track
     int ModuloDiff(int to, int from);        // # sectors between to and from
@@ -23,12 +23,14 @@
 #include "copyright.h"
 #include "interrupt.h"
 #include "system.h"
+#include "synch.h"
 
 // String definitions for debugging messages
 
 static char *intLevelNames[] = { "off", "on"};
 static char *intTypeNames[] = { "timer", "disk", "console write", 
-			"console read", "network send", "network recv"};
+			"console read", "elevator", "network send", 
+			"network recv", "alarm"};
 
 //----------------------------------------------------------------------
 // PendingInterrupt::PendingInterrupt
@@ -48,6 +50,107 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int time,
     arg = param;
     when = time;
     type = kind;
+    seq = 0;
+    index = -1;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::PendingQueue, ~PendingQueue
+// 	Initialize an empty queue; delete it, with the interrupts which
+//	never occurred.
+//----------------------------------------------------------------------
+
+PendingQueue::PendingQueue()
+{
+    capacity = PendingQueueInit;
+    heap = new PendingInterrupt *[capacity];
+    size = 0;
+    numScheduled = 0;
+}
+
+PendingQueue::~PendingQueue()
+{
+    for (int i = 0; i < size; i++)
+	delete heap[i];
+    delete [] heap;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::Insert
+// 	Add "pend" to the heap, after those already due at the same time,
+//	doubling the heap if it is full.
+//----------------------------------------------------------------------
+
+void
+PendingQueue::Insert(PendingInterrupt *pend)
+{
+    if (size == capacity) {
+	PendingInterrupt **bigger = new PendingInterrupt *[2 * capacity];
+
+	for (int i = 0; i < size; i++)
+	    bigger[i] = heap[i];
+	delete [] heap;
+	heap = bigger;
+	capacity *= 2;
+    }
+    pend->seq = numScheduled++;
+    Place(size, pend);
+    SiftUp(size++);
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::Remove
+// 	Take "pend" out of the heap: put the last interrupt in its place,
+//	and move that one up or down to where it belongs.
+//----------------------------------------------------------------------
+
+void
+PendingQueue::Remove(PendingInterrupt *pend)
+{
+    int i = pend->index;
+
+    ASSERT(i >= 0 && i < size && heap[i] == pend);
+    pend->index = -1;
+    if (i == --size)
+	return;
+    Place(i, heap[size]);
+    if (i > 0 && Before(heap[i], heap[(i - 1) / 2]))
+	SiftUp(i);
+    else
+	SiftDown(i);
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::SiftUp, SiftDown
+// 	Restore the heap order, moving heap[i] towards the root while it
+//	occurs before its parent, or towards the leaves while one of its
+//	children occurs before it.
+//----------------------------------------------------------------------
+
+void
+PendingQueue::SiftUp(int i)
+{
+    PendingInterrupt *pend = heap[i];
+
+    for (; i > 0 && Before(pend, heap[(i - 1) / 2]); i = (i - 1) / 2)
+	Place(i, heap[(i - 1) / 2]);
+    Place(i, pend);
+}
+
+void
+PendingQueue::SiftDown(int i)
+{
+    PendingInterrupt *pend = heap[i];
+    int child;
+
+    for (; (child = 2 * i + 1) < size; i = child) {
+	if (child + 1 < size && Before(heap[child + 1], heap[child]))
+	    child++;
+	if (!Before(heap[child], pend))
+	    break;
+	Place(i, heap[child]);
+    }
+    Place(i, pend);
 }
 
 //----------------------------------------------------------------------
@@ -60,7 +163,8 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int time,
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new List();
+    pending = new PendingQueue();
+    nextDue = 0;
     inHandler = FALSE;
     yieldOnReturn = FALSE;
     status = SystemMode;
@@ -73,8 +177,6 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty())
-	delete (PendingInterrupt *)pending->Remove();
     delete pending;
 }
 
@@ -146,6 +248,12 @@ Interrupt::Enable()
 //	Two things can cause OneTick to be called:
 //		interrupts are re-enabled
 //		a user instruction is executed
+//
+//	With several CPUs, the time is that of the CPU running now, and
+//	this is where the CPUs take turns (cf. Scheduler::Interleave).
+//
+//	The pending interrupts are only looked at once the first of them
+//	is due, rather than on every tick.
 //----------------------------------------------------------------------
 void
 Interrupt::OneTick()
@@ -153,21 +261,25 @@ Interrupt::OneTick()
     MachineStatus old = status;
 
 // advance simulated time
-    if (status == SystemMode) {
-        stats->totalTicks += SystemTick;
-	stats->systemTicks += SystemTick;
-    } else {					// USER_PROGRAM
-	stats->totalTicks += UserTick;
-	stats->userTicks += UserTick;
-    }
+    int ticks = (status == SystemMode) ? SystemTick : UserTick;
+
+    if (status == SystemMode)
+	stats->systemTicks += ticks;
+    else					// USER_PROGRAM
+	stats->userTicks += ticks;
+    if (scheduler->NumCPUs() == 1)
+	stats->totalTicks += ticks;
+    else
+	scheduler->Elapse(ticks);		// per CPU clocks
     DEBUG('i', "\n== Tick %d ==\n", stats->totalTicks);
 
 // check any pending interrupts are now ready to fire
     ChangeLevel(IntOn, IntOff);		// first, turn off interrupts
 					// (interrupt handlers run with
 					// interrupts disabled)
-    while (CheckIfDue(FALSE))		// check for pending interrupts
-	;
+    if (stats->totalTicks >= nextDue)	// no need to look before then
+	while (CheckIfDue(FALSE))	// check for pending interrupts
+	    ;
     ChangeLevel(IntOff, IntOn);		// re-enable interrupts
     if (yieldOnReturn) {		// if the timer device handler asked 
 					// for a context switch, ok to do it now
@@ -175,6 +287,16 @@ Interrupt::OneTick()
  	status = SystemMode;		// yield is a kernel routine
 	currentThread->Yield();
 	status = old;
+    } else if (scheduler->NumCPUs() > 1) {	// maybe let another CPU run
+	bool preempted;
+
+	status = SystemMode;
+	ChangeLevel(IntOn, IntOff);
+	preempted = scheduler->Interleave();
+	ChangeLevel(IntOff, IntOn);
+	if (preempted)
+	    currentThread->Yield();
+	status = old;
     }
 }
 
@@ -242,6 +364,9 @@ Interrupt::Halt()
 {
     printf("Machine halting!\n\n");
     stats->Print();
+#ifdef SYNCH_PROF
+    SynchProf::PrintAll();
+#endif
     Cleanup();     // Never returns.
 }
 
@@ -250,7 +375,8 @@ Interrupt::Halt()
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: just put it in the PendingQueue.  Return it, so
+//	that it can be cancelled before it occurs.
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -261,7 +387,7 @@ Interrupt::Halt()
 //		 interrupt is to occur
 //	"type" is the hardware device that generated the interrupt
 //----------------------------------------------------------------------
-void
+PendingInterrupt *
 Interrupt::Schedule(VoidFunctionPtr handler, int arg, int fromNow, IntType type)
 {
     int when = stats->totalTicks + fromNow;
@@ -271,7 +397,24 @@ Interrupt::Schedule(VoidFunctionPtr handler, int arg, int fromNow, IntType type)
 					intTypeNames[type], when);
     ASSERT(fromNow > 0);
 
-    pending->SortedInsert(toOccur, when);
+    pending->Insert(toOccur);
+    nextDue = min(nextDue, when);
+    return toOccur;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Cancel
+// 	Take back "pend", returned by Schedule, before it occurs; it
+//	is deleted.  (If it has occurred, it has been deleted already:
+//	it must not be cancelled.)
+//----------------------------------------------------------------------
+void
+Interrupt::Cancel(PendingInterrupt *pend)
+{
+    DEBUG('i', "Cancelling interrupt handler the %s at time = %d\n", 
+					intTypeNames[pend->type], pend->when);
+    pending->Remove(pend);
+    delete pend;
 }
 
 //----------------------------------------------------------------------
@@ -297,26 +440,29 @@ Interrupt::CheckIfDue(bool advanceClock)
 					// to invoke an interrupt handler
     if (DebugIsEnabled('i'))
 	DumpState();
-    PendingInterrupt *toOccur = 
-		(PendingInterrupt *)pending->SortedRemove(&when);
+    PendingInterrupt *toOccur = pending->First();
 
-    if (toOccur == NULL)		// no pending interrupts
+    if (toOccur == NULL) {		// no pending interrupts
+	nextDue = NeverDue;
 	return FALSE;			
+    }
+    when = toOccur->when;
 
     if (advanceClock && when > stats->totalTicks) {	// advance the clock
 	stats->idleTicks += (when - stats->totalTicks);
 	stats->totalTicks = when;
-    } else if (when > stats->totalTicks) {	// not time yet, put it back
-	pending->SortedInsert(toOccur, when);
+    } else if (when > stats->totalTicks) {	// not time yet
+	nextDue = when;
 	return FALSE;
     }
 
 // Check if there is nothing more to do, and if so, quit
     if ((status == IdleMode) && (toOccur->type == TimerInt) 
-				&& pending->IsEmpty()) {
-	 pending->SortedInsert(toOccur, when);
+				&& pending->NumPending() == 1)
 	 return FALSE;
-    }
+
+    pending->Remove(toOccur);
+    nextDue = pending->IsEmpty() ? NeverDue : pending->First()->when;
 
     DEBUG('i', "Invoking interrupt handler for the %s at time %d\n", 
 			intTypeNames[toOccur->type], toOccur->when);
@@ -350,6 +496,28 @@ PrintPending(int arg)
 	intTypeNames[pend->type], pend->when);
 }
 
+//----------------------------------------------------------------------
+// PendingQueue::Print
+// 	Print the pending interrupts, in the order they will occur: sort
+//	a copy of the heap (only for debugging, so simply by insertion).
+//----------------------------------------------------------------------
+
+void
+PendingQueue::Print()
+{
+    PendingInterrupt **sorted = new PendingInterrupt *[size];
+    int i, j;
+
+    for (i = 0; i < size; i++) {
+	for (j = i; j > 0 && Before(heap[i], sorted[j - 1]); j--)
+	    sorted[j] = sorted[j - 1];
+	sorted[j] = heap[i];
+    }
+    for (i = 0; i < size; i++)
+	PrintPending((int)sorted[i]);
+    delete [] sorted;
+}
+
 //----------------------------------------------------------------------
 // DumpState
 // 	Print the complete interrupt state - the status, and all interrupts
@@ -363,7 +531,7 @@ Interrupt::DumpState()
 					intLevelNames[level]);
     printf("Pending interrupts:\n");
     fflush(stdout);
-    pending->Mapcar(PrintPending);
+    pending->Print();
     printf("End of pending interrupts\n");
     fflush(stdout);
 }
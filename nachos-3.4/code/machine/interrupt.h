@@ -48,9 +48,13 @@ enum MachineStatus {IdleMode, SystemMode, UserMode};
 
 // IntType records which hardware device generated an interrupt.
 // In Nachos, we support a hardware timer device, a disk, a console
-// display and keyboard, and a network.
+// display and keyboard, and a network.  An alarm wakes a thread up
+// at a given time (cf. Thread::WaitNextPeriod).
 enum IntType { TimerInt, DiskInt, ConsoleWriteInt, ConsoleReadInt, 
-				ElevatorInt, NetworkSendInt, NetworkRecvInt};
+				ElevatorInt, NetworkSendInt, NetworkRecvInt,
+				AlarmInt};
+
+#define NeverDue	0x7fffffff	// time of an interrupt never scheduled
 
 // The following class defines an interrupt that is scheduled
 // to occur in the future.  The internal data structures are
@@ -67,6 +71,45 @@ class PendingInterrupt {
     int arg;                    // The argument to the function.
     int when;			// When the interrupt is supposed to fire
     IntType type;		// for debugging
+    unsigned int seq;		// order it was scheduled in, among those
+				// due at the same time
+    int index;			// where it is in the PendingQueue
+};
+
+#define PendingQueueInit 64	// # of interrupts the queue holds at first
+
+// The following class keeps the interrupts scheduled to occur in the
+// future, in a binary heap ordered by time -- and, among those due at
+// the same time, by the order they were scheduled in.  Inserting,
+// taking out the first, and cancelling one take O(log n) time, however
+// many interrupts are pending.  The heap doubles when it is full.
+
+class PendingQueue {
+  public:
+    PendingQueue();			// the queue is empty
+    ~PendingQueue();			// delete the interrupts left
+
+    void Insert(PendingInterrupt *pend);
+    PendingInterrupt *First()		// the next to occur, or NULL
+		{ return (size > 0) ? heap[0] : NULL; }
+    void Remove(PendingInterrupt *pend); // take "pend" out of the queue
+    bool IsEmpty() { return size == 0; }
+    int NumPending() { return size; }
+    void Print();			// print them, first to occur first
+
+  private:
+    bool Before(PendingInterrupt *a, PendingInterrupt *b)
+		{ return a->when < b->when || 
+			(a->when == b->when && a->seq < b->seq); }
+    void Place(int i, PendingInterrupt *pend)
+		{ heap[i] = pend; pend->index = i; }
+    void SiftUp(int i);			// move heap[i] up to its place
+    void SiftDown(int i);		// move heap[i] down to its place
+
+    PendingInterrupt **heap;		// heap[0] is the first to occur
+    int size;				// # of interrupts in the heap
+    int capacity;			// # of entries of "heap"
+    unsigned int numScheduled;		// next "seq"
 };
 
 // The following class defines the data structures for the simulation
@@ -94,6 +137,8 @@ class Interrupt {
     
     void YieldOnReturn();		// cause a context switch on return 
 					// from an interrupt handler
+    bool inInterruptHandler() { return inHandler; }
+					// are we running a handler?
 
     MachineStatus getStatus() { return status; } // idle, kernel, user
     void setStatus(MachineStatus st) { status = st; }
@@ -106,16 +151,20 @@ class Interrupt {
     // but they need to be public since they are called by the
     // hardware device simulators.
 
-    void Schedule(VoidFunctionPtr handler,// Schedule an interrupt to occur
-	int arg, int when, IntType type);// at time ``when''.  This is called
+    PendingInterrupt *Schedule(VoidFunctionPtr handler,
+	int arg, int when, IntType type);// Schedule an interrupt to occur
+					// at time ``when''.  This is called
     					// by the hardware device simulators.
+    void Cancel(PendingInterrupt *pend); // Take back an interrupt which
+					// has not occurred yet
     
     void OneTick();       		// Advance simulated time
 
   private:
     IntStatus level;		// are interrupts enabled or disabled?
-    List *pending;		// the list of interrupts scheduled
-				// to occur in the future
+    PendingQueue *pending;	// the interrupts scheduled to occur
+				// in the future
+    int nextDue;		// no pending interrupt is due before then
     bool inHandler;		// TRUE if we are running an interrupt handler
     bool yieldOnReturn; 	// TRUE if we are to context switch
 				// on return from the interrupt handler
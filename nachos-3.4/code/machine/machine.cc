@@ -10,6 +10,9 @@
 #include "copyright.h"
 #include "machine.h"
 #include "system.h"
+#ifdef INV_PG
+#include "pagerepl.h"
+#endif
 
 // Textual names of the exceptions that can be generated by user program
 // execution, for debugging.
@@ -50,9 +53,11 @@ void CheckEndian()
 //
 //	"debug" -- if TRUE, drop into the debugger after each user instruction
 //		is executed.
+//	"threaded" -- if TRUE, execute user code with the threaded-dispatch
+//		engine (see Machine::RunThreaded).
 //----------------------------------------------------------------------
 
-Machine::Machine(bool debug)
+Machine::Machine(bool debug, bool threaded)
 {
     int i;
 
@@ -63,6 +68,12 @@ Machine::Machine(bool debug)
       	mainMemory[i] = 0;
 
     mem_bmp = new BitMap(NumPhysPages); // all bits are cleared      
+
+    FlushTransCache();
+    decodeCache = new Instruction[NumPhysPages * InstrsPerPage];
+    decodeValid = new bool[NumPhysPages];
+    for (i = 0; i < NumPhysPages; i++)
+        decodeValid[i] = FALSE; // nothing is predecoded yet
     
 #ifdef USE_TLB
     tlb = new TranslationEntry[TLBSize];
@@ -76,19 +87,27 @@ Machine::Machine(bool debug)
     for (i = 0; i < NumPhysPages; i++) {
         invPageTable[i].physicalPage = i;
         invPageTable[i].valid = FALSE;
-        invPageTable[i].tid = -1; // indicating this entry does not
-                        // belong to any resident set of thread
-    }
-    for (i = 0; i < NumPhysPages / ResSize; i++) {
-        swapFiles[i] == NULL;
-        ro_bmp[i] == NULL;
+        invPageTable[i].sid = -1; // indicating this entry does not
+                        // belong to any resident set
+        frameRefs[i] = 0;
+        textSector[i] = -1;
+        resNext[i] = (i + 1 < NumPhysPages) ? i + 1 : -1;
     }
+    freeHead = 0; // all page frames are free, in ascending order
+    replacer = NULL; // to be set in Initialize
+    for (i = 0; i < PgHashSize; i++)
+        hashAnchor[i] = textAnchor[i] = -1;
+    numSpaces = 0; // no sid yet: the tables are allocated by GrowSpaces
+    freeSpace = currentSpace = -1;
+    nextFreeSpace = resHead = invalidHead = resCount = NULL;
+    userTime = runStart = lastFault = NULL;
    
 #else // use normal page table, one per user prog. do not support VM.
     pageTable = NULL; // to be set in AddrSpace::RestoreState
 #endif // INV_PG
 
     singleStep = debug;
+    threadedDispatch = threaded;
     CheckEndian();
 }
 
@@ -100,9 +119,21 @@ Machine::Machine(bool debug)
 Machine::~Machine()
 {
     delete [] mainMemory;
+    delete [] decodeCache;
+    delete [] decodeValid;
     delete mem_bmp;
     if (tlb != NULL)
         delete [] tlb;
+#ifdef INV_PG
+    delete replacer;
+    delete [] nextFreeSpace;
+    delete [] resHead;
+    delete [] invalidHead;
+    delete [] resCount;
+    delete [] userTime;
+    delete [] runStart;
+    delete [] lastFault;
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -231,53 +262,519 @@ void Machine::WriteRegister(int num, int value)
 #ifdef INV_PG // use global inverted page table, thus support VM.
 //----------------------------------------------------------------------
 // Machine::FindInvalidEntry
-//      In the resident set of _tid, find any invalid entry. 
+//      In the resident set of sid, find any invalid entry. 
 //      As a side effect, set bit in mem_bmp.
 //      If not found, return -1.
 //----------------------------------------------------------------------
-int Machine::FindInvalidEntry(int _tid) 
+int Machine::FindInvalidEntry(int sid) 
 {
-    for (int i = 0; i < NumPhysPages; i++) {
-        if (!invPageTable[i].valid && invPageTable[i].tid == _tid) {
-            ASSERT(!mem_bmp->Test(i));
-            mem_bmp->Mark(i);
-            return i;
-        }
+    int i = invalidHead[sid];
+
+    if (i != -1) {
+        invalidHead[sid] = invalidNext[i];
+        ASSERT(!invPageTable[i].valid && invPageTable[i].sid == sid);
+        ASSERT(!mem_bmp->Test(i));
+        mem_bmp->Mark(i);
     }
-    return -1;
+    return i;
 }
 
 //----------------------------------------------------------------------
 // Machine::FindReplEntry
-//      Page replacement algorithm. 
+//      Page replacement algorithm: ask the policy chosen in 
+//      Initialize (cf. pagerepl.h).  Called only when all the 
+//      page frames of the resident set of sid are valid.
 //      Return the selected ppn.
 //----------------------------------------------------------------------
-int Machine::FindReplEntry(int _tid)
+int Machine::FindReplEntry(int sid)
+{
+    return replacer->Victim(sid);
+}
+
+//----------------------------------------------------------------------
+// Machine::FindPage
+//      Return the ppn holding virtual page "vpn" of space "sid",
+//      or -1 if it is not in memory.
+//----------------------------------------------------------------------
+int Machine::FindPage(int sid, int vpn)
+{
+    int i;
+
+    for (i = hashAnchor[PageHash(sid, vpn)]; i != -1; i = hashNext[i]) {
+        if (invPageTable[i].virtualPage == vpn && invPageTable[i].sid == sid)
+            break;
+    }
+    return i;
+}
+
+//----------------------------------------------------------------------
+// Machine::HashRemove
+//      Unlink the valid entry invPageTable[ppn] from its hash chain,
+//      and from its chain of code pages if it is in one.
+//----------------------------------------------------------------------
+void Machine::HashRemove(int ppn)
+{
+    TranslationEntry *entry = &invPageTable[ppn];
+    int *p = &hashAnchor[PageHash(entry->sid, entry->virtualPage)];
+
+    while (*p != ppn) {
+        ASSERT(*p != -1);
+        p = &hashNext[*p];
+    }
+    *p = hashNext[ppn];
+
+    if (textSector[ppn] == -1)
+        return;
+    p = &textAnchor[TextHash(textSector[ppn], entry->virtualPage)];
+    while (*p != ppn) {
+        ASSERT(*p != -1);
+        p = &textNext[*p];
+    }
+    *p = textNext[ppn];
+    textSector[ppn] = -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::FindTextPage
+//      Return a valid entry mapping the code page "vpn" of the 
+//      executable whose file header is at "sector", in the resident
+//      set of any thread, or -1 if there is none.  Code pages are 
+//      never written, so whoever has loaded one can share it.
+//----------------------------------------------------------------------
+int Machine::FindTextPage(int sector, int vpn)
+{
+    int i;
+
+    for (i = textAnchor[TextHash(sector, vpn)]; i != -1; i = textNext[i]) {
+        if (invPageTable[i].virtualPage == vpn && textSector[i] == sector)
+            break;
+    }
+    return i;
+}
+
+//----------------------------------------------------------------------
+// Machine::AddTextPage
+//      Record that the valid, read-only entry invPageTable[ppn] maps a
+//      code page of the executable whose file header is at "sector", 
+//      so that FindTextPage returns it until it is unmapped.
+//----------------------------------------------------------------------
+void Machine::AddTextPage(int ppn, int sector)
+{
+    int *p = &textAnchor[TextHash(sector, invPageTable[ppn].virtualPage)];
+
+    ASSERT(invPageTable[ppn].valid && invPageTable[ppn].readOnly);
+    ASSERT(textSector[ppn] == -1);
+    textSector[ppn] = sector;
+    textNext[ppn] = *p;
+    *p = ppn;
+}
+
+//----------------------------------------------------------------------
+// Machine::MapPage
+//      Make invPageTable[ppn] a valid translation of "vpn", for the 
+//      space whose resident set contains ppn.  If ppn was translating
+//      another vpn (i.e. it is being replaced), that translation is 
+//      dropped.  ppn must not be in the invalid list of the space, 
+//      i.e. it must come from FindInvalidEntry or FindReplEntry.
+//----------------------------------------------------------------------
+void Machine::MapPage(int ppn, int vpn)
+{
+    TranslationEntry *entry = &invPageTable[ppn];
+    int *p;
+
+    ASSERT(entry->sid != -1);
+    if (entry->valid) { // forget the old translation
+        UnshareFrame(ppn, FALSE);
+        HashRemove(ppn);
+    }
+    ASSERT(entry->physicalPage == ppn);
+    frameRefs[ppn] = 1;
+    entry->virtualPage = vpn;
+    entry->valid = TRUE;
+    p = &hashAnchor[PageHash(entry->sid, vpn)];
+    hashNext[ppn] = *p;
+    *p = ppn;
+}
+
+//----------------------------------------------------------------------
+// Machine::UnmapPage
+//      Make the valid entry invPageTable[ppn] invalid, because a new 
+//      page is about to be read into it.  The page frame stays in the
+//      resident set (and in mem_bmp), but not in the invalid list, so
+//      that nobody else takes it meanwhile; MapPage makes it valid again.
+//----------------------------------------------------------------------
+void Machine::UnmapPage(int ppn)
+{
+    ASSERT(invPageTable[ppn].valid);
+    UnshareFrame(ppn, FALSE);
+    HashRemove(ppn);
+    invPageTable[ppn].valid = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Machine::ShareFrame
+//      Copy-on-write: make the valid entry invPageTable[ppn] translate
+//      to the page frame used by the valid entry "from", instead of 
+//      copying its contents.  Both become read-only, so that the first
+//      write to either one faults, and gets a private copy (cf. 
+//      UnshareFrame).  The page frame of ppn stays in its resident set,
+//      unused, to receive that copy.
+//----------------------------------------------------------------------
+void Machine::ShareFrame(int ppn, int from)
 {
-#ifdef PG_FIFO
-    // TODO
-#else // PG_LRU
-    return currentThread->space->pg_lru[0];
-#endif // PG_FIFO
+    TranslationEntry *entry = &invPageTable[ppn];
+    int frame = invPageTable[from].physicalPage;
+
+    ASSERT(entry->valid && entry->physicalPage == ppn && frameRefs[ppn] == 1);
+    ASSERT(invPageTable[from].valid);
+    frameRefs[ppn] = 0;
+    entry->physicalPage = frame;
+    frameRefs[frame]++;
+    entry->readOnly = invPageTable[from].readOnly = TRUE;
+    if (textSector[from] != -1) // a code page: others may share it too
+        AddTextPage(ppn, textSector[from]);
+}
+
+//----------------------------------------------------------------------
+// Machine::UnshareFrame
+//      Stop sharing the page of the valid entry invPageTable[ppn] with
+//      other entries, if it does.  If "keepPage", ppn is being written
+//      to, and must end up with a private copy of the page in its own 
+//      page frame.  Otherwise the page is about to be dropped from ppn,
+//      and nothing needs to be copied into it.
+//
+//      If ppn uses the page frame of another entry, it just lets go of
+//      it.  If others use the page frame of ppn, the page is moved to
+//      the page frame of one of them, which the others use from now on.
+//      Either way, no disk I/O is needed.
+//----------------------------------------------------------------------
+void Machine::UnshareFrame(int ppn, bool keepPage)
+{
+    TranslationEntry *entry = &invPageTable[ppn];
+    int i, frame = entry->physicalPage, to = -1;
+
+    if (frame != ppn) { // ppn uses the page frame of another entry
+        if (keepPage) {
+            memcpy(&mainMemory[ppn * PageSize], &mainMemory[frame * PageSize],
+                    PageSize);
+            InvalidateDecoded(ppn);
+            stats->numCopyOnWrites++;
+        }
+        frameRefs[frame]--;
+        frameRefs[ppn] = 1;
+        entry->physicalPage = ppn;
+        return;
+    }
+    if (frameRefs[ppn] == 1) // not shared
+        return;
+    if (keepPage)
+        stats->numCopyOnWrites++;
+    for (i = 0; i < NumPhysPages; i++) {
+        if (i == ppn || invPageTable[i].physicalPage != ppn)
+            continue;
+        if (to == -1) { // the page goes to the first one found
+            to = i;
+            memcpy(&mainMemory[to * PageSize], &mainMemory[ppn * PageSize],
+                    PageSize);
+            InvalidateDecoded(to);
+            frameRefs[to] = frameRefs[ppn] - 1;
+        }
+        invPageTable[i].physicalPage = to;
+    }
+    ASSERT(to != -1);
+    frameRefs[ppn] = 1;
+}
+
+//----------------------------------------------------------------------
+// Machine::TakeFreeFrame
+//      Add a page frame from the free list to the resident set of 
+//      space "sid", as an invalid entry.  If the free list is empty,
+//      try to steal one from another space.
+//      Return the ppn, or -1 if there was none.
+//----------------------------------------------------------------------
+int Machine::TakeFreeFrame(int sid)
+{
+    int ppn = freeHead;
+
+    if (ppn == -1) {
+        ReleaseFrame(ppn = StealFrame(sid));
+        if (ppn == -1)
+            return -1;
+        ppn = freeHead;
+    }
+    ASSERT(invPageTable[ppn].valid == FALSE && invPageTable[ppn].sid == -1);
+    freeHead = resNext[ppn];
+    invPageTable[ppn].sid = sid;
+    resNext[ppn] = resHead[sid];
+    resHead[sid] = ppn;
+    invalidNext[ppn] = invalidHead[sid];
+    invalidHead[sid] = ppn;
+    resCount[sid]++;
+    return ppn;
+}
+
+//----------------------------------------------------------------------
+// Machine::StealFrame
+//      Find a page frame which can be taken away from its space, 
+//      without any disk I/O, for space "sid".  The victim is the 
+//      space which has gone longest without a page fault, in its own
+//      virtual time, among those with more than MinResSize page frames.  The page frame is one 
+//      of its invalid ones if any, else a clean one: preferably one 
+//      whose contents are unused because its entry shares the page 
+//      frame of another (cf. ShareFrame), else one not used recently.
+//
+//      Dirty pages are never stolen: writing them back would block, 
+//      and their thread might run meanwhile.  Page frames being 
+//      refilled (cf. UnmapPage) are not stolen either.
+//
+//      Return the ppn, still owned by the victim, or -1.
+//----------------------------------------------------------------------
+int Machine::StealFrame(int sid)
+{
+    int t, ppn, cand, gap, victimGap = -1, victim = -1;
+    TranslationEntry *entry;
+
+    for (t = 0; t < numSpaces; t++) {
+        if (t == sid || resCount[t] <= MinResSize)
+            continue;
+        gap = VirtualTime(t) - lastFault[t];
+        if (victim != -1 && gap <= victimGap)
+            continue;
+        cand = invalidHead[t];
+        for (ppn = resHead[t]; cand == -1 && ppn != -1; ppn = resNext[ppn]) {
+            entry = &invPageTable[ppn];
+            if (entry->valid && !entry->dirty && entry->physicalPage != ppn)
+                cand = ppn;
+        }
+        for (ppn = resHead[t]; cand == -1 && ppn != -1; ppn = resNext[ppn]) {
+            entry = &invPageTable[ppn];
+            if (entry->valid && !entry->dirty && !entry->use)
+                cand = ppn;
+        }
+        for (ppn = resHead[t]; cand == -1 && ppn != -1; ppn = resNext[ppn]) {
+            entry = &invPageTable[ppn];
+            if (entry->valid && !entry->dirty)
+                cand = ppn;
+        }
+        if (cand != -1) {
+            victim = cand;
+            victimGap = gap;
+        }
+    }
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// Machine::ReleaseFrame
+//      Take page frame "ppn" out of the resident set of its space, and
+//      put it in the free list.  If it holds a page, the page must be 
+//      clean (or not needed any more): it is simply dropped.
+//      Does nothing if ppn is -1.
+//----------------------------------------------------------------------
+void Machine::ReleaseFrame(int ppn)
+{
+    int *p;
+    TranslationEntry *entry;
+
+    if (ppn == -1)
+        return;
+    entry = &invPageTable[ppn];
+    if (entry->valid) {
+        UnshareFrame(ppn, FALSE);
+        HashRemove(ppn);
+        mem_bmp->Clear(ppn);
+        entry->valid = FALSE;
+    } else { // it must be in the invalid list
+        for (p = &invalidHead[entry->sid]; *p != ppn; p = &invalidNext[*p])
+            ASSERT(*p != -1);
+        *p = invalidNext[ppn];
+    }
+    for (p = &resHead[entry->sid]; *p != ppn; p = &resNext[*p])
+        ASSERT(*p != -1);
+    *p = resNext[ppn];
+    resCount[entry->sid]--;
+    entry->sid = -1;
+    resNext[ppn] = freeHead;
+    freeHead = ppn;
+}
+
+//----------------------------------------------------------------------
+// GrowTable
+//      Return a copy of "table" with room for "newSize" entries; the
+//      new ones are left for the caller to set.
+//----------------------------------------------------------------------
+static int *
+GrowTable(int *table, int size, int newSize)
+{
+    int *newTable = new int[newSize];
+
+    for (int i = 0; i < size; i++)
+        newTable[i] = table[i];
+    delete [] table;
+    return newTable;
+}
+
+//----------------------------------------------------------------------
+// Machine::GrowSpaces
+//      Double the tables kept per sid (or allocate the first 
+//      SpaceTableInit sids), and put the new sids in the free list.
+//----------------------------------------------------------------------
+void Machine::GrowSpaces()
+{
+    int i, newSize = (numSpaces == 0) ? SpaceTableInit : 2 * numSpaces;
+
+    nextFreeSpace = GrowTable(nextFreeSpace, numSpaces, newSize);
+    resHead = GrowTable(resHead, numSpaces, newSize);
+    invalidHead = GrowTable(invalidHead, numSpaces, newSize);
+    resCount = GrowTable(resCount, numSpaces, newSize);
+    userTime = GrowTable(userTime, numSpaces, newSize);
+    runStart = GrowTable(runStart, numSpaces, newSize);
+    lastFault = GrowTable(lastFault, numSpaces, newSize);
+    for (i = numSpaces; i < newSize; i++) {
+        nextFreeSpace[i] = (i + 1 < newSize) ? i + 1 : freeSpace;
+        resHead[i] = invalidHead[i] = -1;
+        resCount[i] = 0;
+        runStart[i] = -1;
+    }
+    freeSpace = numSpaces;
+    numSpaces = newSize;
+}
+
+//----------------------------------------------------------------------
+// Machine::AllocResidentSet
+//      Allocate a sid for a new address space, and give it a resident 
+//      set of (up to) "n" invalid page frames, taken from the free list
+//      or, if need be, from spaces faulting less often.  Return the sid.
+//      If there are not even MinResSize page frames, the program cannot
+//      run: give them back, and the sid, and return -1.
+//----------------------------------------------------------------------
+int Machine::AllocResidentSet(int n)
+{
+    int sid;
+
+    if (freeSpace == -1)
+        GrowSpaces();
+    sid = freeSpace;
+    freeSpace = nextFreeSpace[sid];
+
+    ASSERT(resHead[sid] == -1 && resCount[sid] == 0);
+    userTime[sid] = lastFault[sid] = 0; // as if it had just faulted
+    runStart[sid] = -1;
+    while (resCount[sid] < n && TakeFreeFrame(sid) != -1)
+        ;
+    if (resCount[sid] < MinResSize) {	// out of memory
+        FreeResidentSet(sid);
+        return -1;
+    }
+    return sid;
+}
+
+//----------------------------------------------------------------------
+// Machine::FreeResidentSet
+//      Invalidate all page frames owned by space "sid", and give 
+//      them back to the free list; then free "sid" itself.
+//----------------------------------------------------------------------
+void Machine::FreeResidentSet(int sid)
+{
+    int ppn, next;
+
+    for (ppn = resHead[sid]; ppn != -1; ppn = next) {
+        next = resNext[ppn];
+        if (invPageTable[ppn].valid) {
+            UnshareFrame(ppn, FALSE);
+            HashRemove(ppn);
+            mem_bmp->Clear(ppn);
+            invPageTable[ppn].valid = FALSE;
+        }
+        invPageTable[ppn].sid = -1;
+        resNext[ppn] = freeHead;
+        freeHead = ppn;
+    }
+    resHead[sid] = invalidHead[sid] = -1;
+    resCount[sid] = 0;
+    runStart[sid] = -1;
+    if (currentSpace == sid)
+        currentSpace = -1;
+    nextFreeSpace[sid] = freeSpace;
+    freeSpace = sid;
+}
+
+//----------------------------------------------------------------------
+// Machine::SpaceRuns, SpaceStops, VirtualTime
+//      Keep the virtual time of each address space: the user ticks it
+//      ran, not counting those of the others.  SpaceRuns also tells
+//      Translate which space it translates for.
+//----------------------------------------------------------------------
+void Machine::SpaceRuns(int sid)
+{
+    runStart[sid] = stats->userTicks;
+    currentSpace = sid;
+}
+
+void Machine::SpaceStops(int sid)
+{
+    userTime[sid] = VirtualTime(sid);
+    runStart[sid] = -1;
+}
+
+int Machine::VirtualTime(int sid)
+{
+    if (runStart[sid] == -1)
+        return userTime[sid];
+    return userTime[sid] + stats->userTicks - runStart[sid];
+}
+
+//----------------------------------------------------------------------
+// Machine::AdjustResidentSet
+//      Page fault frequency: space "sid" takes a page fault.
+//      If the previous one was less than PFFGrowTicks ago (in the 
+//      virtual time of the space), give it 
+//      one more page frame (the fault will be served with it).
+//      If it was more than PFFShrinkTicks ago, the space does well 
+//      with less: give back its invalid page frames, and those which 
+//      are clean and unused since their use bit was last cleared, 
+//      keeping at least MinResSize of them.  Then clear the other use
+//      bits.
+//----------------------------------------------------------------------
+void Machine::AdjustResidentSet(int sid)
+{
+    int ppn, next, now = VirtualTime(sid), interval = now - lastFault[sid];
+    TranslationEntry *entry;
+
+    lastFault[sid] = now;
+    if (interval < PFFGrowTicks) {
+        if (invalidHead[sid] == -1)
+            TakeFreeFrame(sid);
+    } else if (interval > PFFShrinkTicks) {
+        for (ppn = resHead[sid]; ppn != -1; ppn = next) {
+            next = resNext[ppn];
+            entry = &invPageTable[ppn];
+            if (resCount[sid] > MinResSize && 
+                    (!entry->valid || (!entry->use && !entry->dirty)))
+                ReleaseFrame(ppn);
+            else
+                entry->use = FALSE;
+        }
+    }
 }
 
 //----------------------------------------------------------------------
 // Machine::PrintInvPageTable
 //      Print out the whole content of inverted page table, 
 //      in the format:
-// ppn      vpn     tid     valid?  readOnly?   use?    dirty?    
+// ppn      vpn     sid     valid?  readOnly?   use?    dirty?    
 // ***      **      ***     ***     ***         ***     ***
 // ***      **      ***     ***     ***         ***     ***
 //----------------------------------------------------------------------
 void Machine::PrintInvPageTable()
 {
     printf(" *** content of inverted page table:\n");
-    printf("\tppn\tvpn\ttid\tvalid?\treadOnly?\tuse?\tdirty?\n");
+    printf("\tppn\tvpn\tsid\tvalid?\treadOnly?\tuse?\tdirty?\n");
     for (int i = 0; i < NumPhysPages; i++) {
         printf("\t%d\t%d\t%d\t%c\t%c\t\t%c\t%c\n",
             invPageTable[i].physicalPage,
             invPageTable[i].virtualPage,
-            invPageTable[i].tid,
+            invPageTable[i].sid,
             (invPageTable[i].valid ? 'Y': 'N'),
             (invPageTable[i].readOnly ? 'Y': 'N'),
             (invPageTable[i].use ? 'Y': 'N'),
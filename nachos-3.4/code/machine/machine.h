@@ -32,9 +32,7 @@
 #define TLB_LRU
 
 #ifdef INV_PG
-// Choose the strategy to use in page replacement
-//#define PG_FIFO
-#define PG_LRU
+class PageReplacer;
 #endif // INV_PG
 
 // Definitions related to the size, and format of user memory
@@ -45,10 +43,29 @@
 
 #define NumPhysPages    32
 #define MemorySize 	(NumPhysPages * PageSize)
+#define InstrsPerPage	(PageSize / 4)	// # of instructions in one page
 #define TLBSize		4		// if there is a TLB, make it small
+#define TransCacheSize	64		// # of vpn's remembered by Translate;
+					// must be a power of 2
 
-// If VM is supported, this is the size of resident set for each thread
+// If VM is supported, page frames belong to address spaces, numbered by
+// a "space id" (sid) of their own rather than by the tid of their thread,
+// so that any number of threads may run user programs; the tables kept
+// per sid start with SpaceTableInit entries, and double when full.
+//
+// The resident set of each address space starts with ResSize
+// page frames, and then grows or shrinks with its page fault frequency:
+// a fault less than PFFGrowTicks after the previous one adds a page 
+// frame, a fault more than PFFShrinkTicks after it gives back the page
+// frames not used since.  The interval is measured in the virtual time
+// of the address space: the user ticks (i.e. instructions) it ran itself.
 #define ResSize 8 
+#define MinResSize 2		// an instruction may touch 2 pages
+#define PFFGrowTicks 200
+#define PFFShrinkTicks 2000
+#define SpaceTableInit 16	// # of sids in the tables at first
+#define PgHashSize NumPhysPages		// # of hash anchors for the inverted
+					// page table
 
 enum ExceptionType { NoException,           // Everything ok!
 		     SyscallException,      // A program executed a system call.
@@ -120,7 +137,8 @@ class Instruction {
 
 class Machine {
   public:
-    Machine(bool debug);	// Initialize the simulation of the hardware
+    Machine(bool debug, bool threaded = FALSE);
+				// Initialize the simulation of the hardware
 				// for running user programs
     ~Machine();			// De-allocate the data structures
 
@@ -134,16 +152,43 @@ class Machine {
 
 // Routines internal to the machine simulation -- DO NOT call these 
 
-    void OneInstruction(Instruction *instr); 	
-    				// Run one instruction of a user program.
+    void OneInstruction(); 	// Run one instruction of a user program.
     void DelayedLoad(int nextReg, int nextVal);  	
 				// Do a pending delayed load (modifying a reg)
+#ifdef __GNUC__
+    void RunThreaded();		// Fast replacement for the loop in Run;
+				// never returns
+#endif
+
+    Instruction *FetchInstruction(int addr);
+				// Translate "addr" and return the predecoded
+				// instruction stored there, decoding the
+				// whole page frame if it isn't cached yet.
+				// Return NULL if an exception was raised.
+    void InvalidateDecoded(int ppn) { decodeValid[ppn] = FALSE; }
+				// Throw away the predecoded instructions of
+				// page frame "ppn".  Must be called by any 
+				// code modifying mainMemory directly.
+    void FlushTransCache();	// Forget the translations remembered by
+				// Translate, on a context switch
 
     bool ReadMem(int addr, int size, int* value);
     bool WriteMem(int addr, int size, int value);
     				// Read or write 1, 2, or 4 bytes of virtual 
 				// memory (at addr).  Return FALSE if a 
 				// correct translation couldn't be found.
+
+    void CopyIn(int addr, int size, char *into);
+    void CopyOut(int addr, int size, char *from);
+				// Copy "size" bytes of virtual memory 
+				// (at addr) from or to the kernel buffer, 
+				// a page at a time.  Page faults are 
+				// handled on the way.
+    int CopyInString(int addr, int size, char *into);
+				// Copy a null-terminated string from 
+				// virtual memory, at most "size" bytes
+				// including the null; return its length,
+				// or size if the null wasn't reached.
     
     ExceptionType Translate(int virtAddr, int* physAddr, int size,bool writing);
     				// Translate an address, and check for 
@@ -151,6 +196,12 @@ class Machine {
 				// the translation entry appropriately,
     				// and return an exception code if the 
 				// translation couldn't be completed.
+    char *UserSpan(int addr, int size, bool writing, int *spanSize);
+				// Translate "addr", handling exceptions
+				// until it succeeds, and return where it
+				// is in mainMemory; the rest of the "size"
+				// bytes is contiguous up to the end of the
+				// page, "spanSize" bytes in all.
 
     void RaiseException(ExceptionType which, int badVAddr);
 				// Trap to the Nachos kernel, because of a
@@ -195,16 +246,43 @@ class Machine {
 #ifdef INV_PG // use global inverted page table, thus support VM.
     TranslationEntry invPageTable[NumPhysPages];
 
-	int FindInvalidEntry(int _tid); // in the resident set of _tid, 
+	int FindInvalidEntry(int sid); // in the resident set of sid, 
 			// find any invalid entry. As a side effect, set bit in mem_bmp.
-	int FindReplEntry(int _tid); // page replacement algo. 
+	int FindReplEntry(int sid); // page replacement algo. 
 			// return the selected ppn.
+	PageReplacer *replacer; // the page replacement policy in use
 	void PrintInvPageTable();
 
-	OpenFile *swapFiles[NumPhysPages / ResSize]; // copy of executables, 
-										// used for swapping page frames
-	BitMap *ro_bmp[NumPhysPages / ResSize]; 
-						// bitmap recording if each vpn is readOnly
+	int FindPage(int sid, int vpn); // ppn holding vpn of sid, or -1
+	void MapPage(int ppn, int vpn); // make invPageTable[ppn] a valid 
+			// translation of vpn, for the space owning it
+	void UnmapPage(int ppn); // make invPageTable[ppn] invalid, but keep
+			// it out of the invalid list: it is being refilled
+	void ShareFrame(int ppn, int from); // make invPageTable[ppn] use
+			// the page frame of "from", copy-on-write (cf. Fork)
+	void UnshareFrame(int ppn, bool keepPage); // stop sharing: give
+			// invPageTable[ppn] a private page frame again
+	int FindTextPage(int sector, int vpn); // a valid entry mapping the
+			// code page vpn of the executable whose file header
+			// is at "sector", whichever thread runs it; or -1
+	void AddTextPage(int ppn, int sector); // invPageTable[ppn] maps a
+			// code page of that executable: share it
+	int AllocResidentSet(int n); // give (up to) n page frames to a 
+			// new sid, and return it; or -1, giving none, if
+			// there are not even MinResSize
+	void FreeResidentSet(int sid); // give back all page frames of sid,
+			// and sid itself
+	void AdjustResidentSet(int sid); // on a page fault of sid, grow or
+			// shrink its resident set according to the fault rate
+	void SpaceRuns(int sid); // the user program of sid starts or
+	void SpaceStops(int sid); // stops running (cf. AddrSpace::SaveState)
+	int VirtualTime(int sid); // user ticks run by sid so far
+	int ResidentSize(int sid) { return resCount[sid]; }
+	int FirstResident(int sid) { return resHead[sid]; }
+	int NextResident(int ppn) { return resNext[ppn]; }
+			// iterate over the resident set of a space: 
+			// for (ppn = FirstResident(sid); ppn != -1; 
+			//			ppn = NextResident(ppn))
 
 #else // use normal page table, one per user prog. do not support VM.
     TranslationEntry *pageTable;
@@ -228,10 +306,67 @@ class Machine {
 #endif // USE_TLB
 
   private:
+#ifdef INV_PG
+    int PageHash(int sid, int vpn) 
+		{ return ((unsigned) (sid * 31 + vpn)) % PgHashSize; }
+    int TextHash(int sector, int vpn)
+		{ return ((unsigned) (sector * 31 + vpn)) % PgHashSize; }
+    void HashRemove(int ppn);	// unlink invPageTable[ppn] from its chains
+    int TakeFreeFrame(int sid); // add a free (or stolen) page frame to
+				// the invalid frames of sid
+    int StealFrame(int sid);	// take a page frame from a space with
+				// a lower page fault rate than sid
+    void ReleaseFrame(int ppn);	// take ppn out of the resident set of 
+				// its space, and put it in the free list
+    void GrowSpaces();		// double the tables kept per sid, 
+				// freeing the new sids
+
+    int hashAnchor[PgHashSize];	// first ppn of each hash chain, or -1
+    int hashNext[NumPhysPages];	// next ppn in the same hash chain; only
+				// valid entries are in the hash chains
+    int resNext[NumPhysPages];	// next ppn in the same resident set, or
+				// in the free list
+    int invalidNext[NumPhysPages]; // next invalid ppn in the same 
+				// resident set
+    int freeHead;		// page frames not owned by any space
+    int numSpaces;		// # of sids in the tables below
+    int freeSpace;		// first free sid, or -1
+    int *nextFreeSpace;		// next free sid after each free one
+    int *resHead;		// page frames owned by each sid
+    int *invalidHead;		// ... which are invalid
+    int *resCount;		// # of page frames owned by each sid
+    int *userTime;		// user ticks run by each sid, up to
+				// when it last stopped running
+    int *runStart;		// stats->userTicks when it last started
+				// running, or -1 if it is not running
+    int *lastFault;		// VirtualTime at the last page fault 
+				// of each sid
+    int currentSpace;		// the sid running now (cf. SpaceRuns)
+    int frameRefs[NumPhysPages]; // # of valid entries whose physicalPage
+				// is this page frame; above 1, it is shared
+    int textAnchor[PgHashSize];	// first ppn of each chain of code pages
+    int textNext[NumPhysPages];	// next ppn in the same chain
+    int textSector[NumPhysPages]; // executable of the code page mapped,
+				// -1 if it is not in a chain
+#endif // INV_PG
+
+    TranslationEntry *transCache[TransCacheSize];
+				// transCache[vpn % TransCacheSize] is the 
+				// TLB (or inverted page table) entry that
+				// last translated vpn, if any.  Only a hint:
+				// Translate checks the entry before using it
+    Instruction *decodeCache;	// predecoded form of every word of
+				// mainMemory, indexed by physAddr / 4
+    bool *decodeValid;		// decodeValid[ppn] is TRUE if the words
+				// of page frame ppn are in decodeCache
+				// and up to date
+
     bool singleStep;		// drop back into the debugger after each
 				// simulated instruction
     int runUntilTime;		// drop back into the debugger when simulated
 				// time reaches this value
+    bool threadedDispatch;	// run user code with RunThreaded instead
+				// of OneInstruction
 };
 
 extern void ExceptionHandler(ExceptionType which);
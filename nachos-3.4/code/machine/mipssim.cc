@@ -29,15 +29,17 @@ static void Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr);
 void
 Machine::Run()
 {
-    Instruction *instr = new Instruction;  // storage for decoded instruction
-
     if(DebugIsEnabled('m'))
         printf("Starting thread \"%s\" at time %d\n",
 	       currentThread->getName(), stats->totalTicks);
 
     interrupt->setStatus(UserMode);
+#ifdef __GNUC__
+    if (threadedDispatch && !singleStep && !DebugIsEnabled('m'))
+		RunThreaded();		// never returns
+#endif
     for (;;) {
-        OneInstruction(instr);
+        OneInstruction();
 		interrupt->OneTick();
 		if (singleStep && (runUntilTime <= stats->totalTicks))
 	  		Debugger();
@@ -88,18 +90,16 @@ TypeToReg(RegType reg, Instruction *instr)
 //	and the register set.
 //----------------------------------------------------------------------
 void
-Machine::OneInstruction(Instruction *instr)
+Machine::OneInstruction()
 {
-    int raw;
+    Instruction *instr;
     int nextLoadReg = 0;
     int nextLoadValue = 0; 	// record delayed load operation, to apply
 				// in the future
 
-    // Fetch instruction 
-    if (!machine->ReadMem(registers[PCReg], 4, &raw))
+    // Fetch instruction, already decoded
+    if ((instr = FetchInstruction(registers[PCReg])) == NULL)
 		return; // exception occurred
-    instr->value = raw;
-    instr->Decode();
 
     if (DebugIsEnabled('m')) {
 		ASSERT(instr->opCode <= MaxOpcode);
@@ -562,6 +562,415 @@ Machine::OneInstruction(Instruction *instr)
     registers[NextPCReg] = pcAfter;
 }
 
+#ifdef __GNUC__
+//----------------------------------------------------------------------
+// Machine::RunThreaded
+// 	The fast execution engine, used instead of the loop in Machine::Run
+//	when Nachos is started with "-td".  Never returns.
+//
+//	The instructions are the same as in OneInstruction, and their
+//	effect on registers, memory, exceptions and simulated time is
+//	identical (so that the output of both engines can be diffed), but:
+//	   each handler jumps directly to the handler of the next 
+//		instruction (GNU "labels as values"), instead of going back
+//		through one shared switch statement;
+//	   the delayed load and the PC update are done inline;
+//	   there is no tracing or single stepping -- use the reference 
+//		engine (without "-td") for that.
+//----------------------------------------------------------------------
+
+// Finish the current instruction: apply the pending delayed load and 
+// advance the program counters, exactly as OneInstruction does.
+#define RETIRE()							\
+  { registers[registers[LoadReg]] = registers[LoadValueReg];		\
+    registers[LoadReg] = nextLoadReg;					\
+    registers[LoadValueReg] = nextLoadValue;				\
+    registers[0] = 0;							\
+    registers[PrevPCReg] = registers[PCReg];				\
+    registers[PCReg] = registers[NextPCReg];				\
+    registers[NextPCReg] = pcAfter; }
+
+// Advance simulated time, then fetch the next instruction and jump to 
+// its handler.  A fetch that raises an exception costs a tick, as it
+// does in Run.
+#define DISPATCH()							\
+  { interrupt->OneTick();						\
+    while ((instr = FetchInstruction(registers[PCReg])) == NULL)	\
+		interrupt->OneTick();					\
+    nextLoadReg = 0;							\
+    nextLoadValue = 0;							\
+    pcAfter = registers[NextPCReg] + 4;					\
+    goto *dispatch[(int) instr->opCode]; }
+
+#define NEXT()		{ RETIRE() DISPATCH() }
+#define TRAP(which, badVAddr)	{ RaiseException(which, badVAddr); DISPATCH() }
+
+void
+Machine::RunThreaded()
+{
+    static void *dispatch[MaxOpcode + 1] = {
+	&&do_bad, &&do_ADD, &&do_ADDI, &&do_ADDIU,		// 0
+	&&do_ADDU, &&do_AND, &&do_ANDI, &&do_BEQ,
+	&&do_BGEZ, &&do_BGEZAL, &&do_BGTZ, &&do_BLEZ,		// 8
+	&&do_BLTZ, &&do_BLTZAL, &&do_BNE, &&do_bad,
+	&&do_DIV, &&do_DIVU, &&do_J, &&do_JAL,			// 16
+	&&do_JALR, &&do_JR, &&do_LB, &&do_LBU,
+	&&do_LH, &&do_LHU, &&do_LUI, &&do_LW,			// 24
+	&&do_LWL, &&do_LWR, &&do_bad, &&do_MFHI,
+	&&do_MFLO, &&do_bad, &&do_MTHI, &&do_MTLO,		// 32
+	&&do_MULT, &&do_MULTU, &&do_NOR, &&do_OR,
+	&&do_ORI, &&do_bad, &&do_SB, &&do_SH,			// 40
+	&&do_SLL, &&do_SLLV, &&do_SLT, &&do_SLTI,
+	&&do_SLTIU, &&do_SLTU, &&do_SRA, &&do_SRAV,		// 48
+	&&do_SRL, &&do_SRLV, &&do_SUB, &&do_SUBU,
+	&&do_SW, &&do_SWL, &&do_SWR, &&do_XOR,			// 56
+	&&do_XORI, &&do_SYSCALL, &&do_illegal, &&do_illegal
+    };
+    Instruction *instr;
+    int nextLoadReg, nextLoadValue;	// delayed load of this instruction
+    int pcAfter;			// next pc, unless there's a branch
+    int sum, diff, tmp, value;
+    unsigned int rs, rt, imm;
+
+    while ((instr = FetchInstruction(registers[PCReg])) == NULL)
+		interrupt->OneTick();
+    nextLoadReg = 0;
+    nextLoadValue = 0;
+    pcAfter = registers[NextPCReg] + 4;
+    goto *dispatch[(int) instr->opCode];
+
+  do_ADD:
+    sum = registers[instr->rs] + registers[instr->rt];
+    if (!((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT) &&
+		((registers[instr->rs] ^ sum) & SIGN_BIT))
+		TRAP(OverflowException, 0);
+    registers[instr->rd] = sum;
+    NEXT();
+
+  do_ADDI:
+    sum = registers[instr->rs] + instr->extra;
+    if (!((registers[instr->rs] ^ instr->extra) & SIGN_BIT) &&
+		((instr->extra ^ sum) & SIGN_BIT))
+		TRAP(OverflowException, 0);
+    registers[instr->rt] = sum;
+    NEXT();
+
+  do_ADDIU:
+    registers[instr->rt] = registers[instr->rs] + instr->extra;
+    NEXT();
+
+  do_ADDU:
+    registers[instr->rd] = registers[instr->rs] + registers[instr->rt];
+    NEXT();
+
+  do_AND:
+    registers[instr->rd] = registers[instr->rs] & registers[instr->rt];
+    NEXT();
+
+  do_ANDI:
+    registers[instr->rt] = registers[instr->rs] & (instr->extra & 0xffff);
+    NEXT();
+
+  do_BEQ:
+    if (registers[instr->rs] == registers[instr->rt])
+		pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    NEXT();
+
+  do_BGEZAL:
+    registers[R31] = registers[NextPCReg] + 4;
+  do_BGEZ:
+    if (!(registers[instr->rs] & SIGN_BIT))
+		pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    NEXT();
+
+  do_BGTZ:
+    if (registers[instr->rs] > 0)
+		pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    NEXT();
+
+  do_BLEZ:
+    if (registers[instr->rs] <= 0)
+		pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    NEXT();
+
+  do_BLTZAL:
+    registers[R31] = registers[NextPCReg] + 4;
+  do_BLTZ:
+    if (registers[instr->rs] & SIGN_BIT)
+		pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    NEXT();
+
+  do_BNE:
+    if (registers[instr->rs] != registers[instr->rt])
+		pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    NEXT();
+
+  do_DIV:
+    if (registers[instr->rt] == 0) {
+		registers[LoReg] = 0;
+		registers[HiReg] = 0;
+    } else {
+		registers[LoReg] = registers[instr->rs] / registers[instr->rt];
+		registers[HiReg] = registers[instr->rs] % registers[instr->rt];
+    }
+    NEXT();
+
+  do_DIVU:
+    rs = (unsigned int) registers[instr->rs];
+    rt = (unsigned int) registers[instr->rt];
+    if (rt == 0) {
+		registers[LoReg] = 0;
+		registers[HiReg] = 0;
+    } else {
+		tmp = rs / rt;
+		registers[LoReg] = (int) tmp;
+		tmp = rs % rt;
+		registers[HiReg] = (int) tmp;
+    }
+    NEXT();
+
+  do_JAL:
+    registers[R31] = registers[NextPCReg] + 4;
+  do_J:
+    pcAfter = (pcAfter & 0xf0000000) | IndexToAddr(instr->extra);
+    NEXT();
+
+  do_JALR:
+    registers[instr->rd] = registers[NextPCReg] + 4;
+  do_JR:
+    pcAfter = registers[instr->rs];
+    NEXT();
+
+  do_LB:
+  do_LBU:
+    tmp = registers[instr->rs] + instr->extra;
+    if (!ReadMem(tmp, 1, &value))
+		DISPATCH();
+    if ((value & 0x80) && (instr->opCode == OP_LB))
+		value |= 0xffffff00;
+    else
+		value &= 0xff;
+    nextLoadReg = instr->rt;
+    nextLoadValue = value;
+    NEXT();
+
+  do_LH:
+  do_LHU:
+    tmp = registers[instr->rs] + instr->extra;
+    if (tmp & 0x1)
+		TRAP(AddressErrorException, tmp);
+    if (!ReadMem(tmp, 2, &value))
+		DISPATCH();
+    if ((value & 0x8000) && (instr->opCode == OP_LH))
+		value |= 0xffff0000;
+    else
+		value &= 0xffff;
+    nextLoadReg = instr->rt;
+    nextLoadValue = value;
+    NEXT();
+
+  do_LUI:
+    registers[instr->rt] = instr->extra << 16;
+    NEXT();
+
+  do_LW:
+    tmp = registers[instr->rs] + instr->extra;
+    if (tmp & 0x3)
+		TRAP(AddressErrorException, tmp);
+    if (!ReadMem(tmp, 4, &value))
+		DISPATCH();
+    nextLoadReg = instr->rt;
+    nextLoadValue = value;
+    NEXT();
+
+  do_LWL:
+    tmp = registers[instr->rs] + instr->extra;
+    ASSERT((tmp & 0x3) == 0);		// cf. OneInstruction
+    if (!ReadMem(tmp, 4, &value))
+		DISPATCH();
+    // tmp is word aligned, so only the "case 0" of OneInstruction applies
+    nextLoadValue = value;
+    nextLoadReg = instr->rt;
+    NEXT();
+
+  do_LWR:
+    tmp = registers[instr->rs] + instr->extra;
+    ASSERT((tmp & 0x3) == 0);		// cf. OneInstruction
+    if (!ReadMem(tmp, 4, &value))
+		DISPATCH();
+    // tmp is word aligned, so only the "case 0" of OneInstruction applies
+    if (registers[LoadReg] == instr->rt)
+		nextLoadValue = registers[LoadValueReg];
+    else
+		nextLoadValue = registers[instr->rt];
+    nextLoadValue = (nextLoadValue & 0xffffff00) | ((value >> 24) & 0xff);
+    nextLoadReg = instr->rt;
+    NEXT();
+
+  do_MFHI:
+    registers[instr->rd] = registers[HiReg];
+    NEXT();
+
+  do_MFLO:
+    registers[instr->rd] = registers[LoReg];
+    NEXT();
+
+  do_MTHI:
+    registers[HiReg] = registers[instr->rs];
+    NEXT();
+
+  do_MTLO:
+    registers[LoReg] = registers[instr->rs];
+    NEXT();
+
+  do_MULT:
+    Mult(registers[instr->rs], registers[instr->rt], TRUE,
+		&registers[HiReg], &registers[LoReg]);
+    NEXT();
+
+  do_MULTU:
+    Mult(registers[instr->rs], registers[instr->rt], FALSE,
+		&registers[HiReg], &registers[LoReg]);
+    NEXT();
+
+  do_NOR:
+    registers[instr->rd] = ~(registers[instr->rs] | registers[instr->rt]);
+    NEXT();
+
+  do_OR:
+    // NOTE: same operands as in OneInstruction, so both engines agree
+    registers[instr->rd] = registers[instr->rs] | registers[instr->rs];
+    NEXT();
+
+  do_ORI:
+    registers[instr->rt] = registers[instr->rs] | (instr->extra & 0xffff);
+    NEXT();
+
+  do_SB:
+    if (!WriteMem((unsigned) 
+		(registers[instr->rs] + instr->extra), 1, registers[instr->rt]))
+		DISPATCH();
+    NEXT();
+
+  do_SH:
+    if (!WriteMem((unsigned) 
+		(registers[instr->rs] + instr->extra), 2, registers[instr->rt]))
+		DISPATCH();
+    NEXT();
+
+  do_SLL:
+    registers[instr->rd] = registers[instr->rt] << instr->extra;
+    NEXT();
+
+  do_SLLV:
+    registers[instr->rd] = registers[instr->rt] <<
+		(registers[instr->rs] & 0x1f);
+    NEXT();
+
+  do_SLT:
+    registers[instr->rd] = (registers[instr->rs] < registers[instr->rt]);
+    NEXT();
+
+  do_SLTI:
+    registers[instr->rt] = (registers[instr->rs] < instr->extra);
+    NEXT();
+
+  do_SLTIU:
+    rs = registers[instr->rs];
+    imm = instr->extra;
+    registers[instr->rt] = (rs < imm);
+    NEXT();
+
+  do_SLTU:
+    rs = registers[instr->rs];
+    rt = registers[instr->rt];
+    registers[instr->rd] = (rs < rt);
+    NEXT();
+
+  do_SRA:
+    registers[instr->rd] = registers[instr->rt] >> instr->extra;
+    NEXT();
+
+  do_SRAV:
+    registers[instr->rd] = registers[instr->rt] >>
+		(registers[instr->rs] & 0x1f);
+    NEXT();
+
+  do_SRL:
+    tmp = registers[instr->rt];
+    tmp >>= instr->extra;
+    registers[instr->rd] = tmp;
+    NEXT();
+
+  do_SRLV:
+    tmp = registers[instr->rt];
+    tmp >>= (registers[instr->rs] & 0x1f);
+    registers[instr->rd] = tmp;
+    NEXT();
+
+  do_SUB:
+    diff = registers[instr->rs] - registers[instr->rt];
+    if (((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT) &&
+		((registers[instr->rs] ^ diff) & SIGN_BIT))
+		TRAP(OverflowException, 0);
+    registers[instr->rd] = diff;
+    NEXT();
+
+  do_SUBU:
+    registers[instr->rd] = registers[instr->rs] - registers[instr->rt];
+    NEXT();
+
+  do_SW:
+    if (!WriteMem((unsigned) 
+		(registers[instr->rs] + instr->extra), 4, registers[instr->rt]))
+		DISPATCH();
+    NEXT();
+
+  do_SWL:
+    tmp = registers[instr->rs] + instr->extra;
+    ASSERT((tmp & 0x3) == 0);		// cf. OneInstruction
+    if (!ReadMem((tmp & ~0x3), 4, &value))
+		DISPATCH();
+    value = registers[instr->rt];
+    if (!WriteMem((tmp & ~0x3), 4, value))
+		DISPATCH();
+    NEXT();
+
+  do_SWR:
+    tmp = registers[instr->rs] + instr->extra;
+    ASSERT((tmp & 0x3) == 0);		// cf. OneInstruction
+    if (!ReadMem((tmp & ~0x3), 4, &value))
+		DISPATCH();
+    value = (value & 0xffffff) | (registers[instr->rt] << 24);
+    if (!WriteMem((tmp & ~0x3), 4, value))
+		DISPATCH();
+    NEXT();
+
+  do_SYSCALL:
+    TRAP(SyscallException, 0);
+
+  do_XOR:
+    registers[instr->rd] = registers[instr->rs] ^ registers[instr->rt];
+    NEXT();
+
+  do_XORI:
+    registers[instr->rt] = registers[instr->rs] ^ (instr->extra & 0xffff);
+    NEXT();
+
+  do_illegal:
+    TRAP(IllegalInstrException, 0);
+
+  do_bad:
+    ASSERT(FALSE);
+    NEXT();
+}
+
+#undef RETIRE
+#undef DISPATCH
+#undef NEXT
+#undef TRAP
+#endif // __GNUC__
+
 //----------------------------------------------------------------------
 // Machine::UpdatePCinSyscall
 // 	Advance program counter in syscall handler
@@ -22,6 +22,15 @@ Statistics::Statistics()
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numPageReplacements = numPageOuts = numCopyOnWrites = 0;
+    replPolicy = NULL;
+    numCPUs = 1;
+    for (int i = 0; i < MaxNumCPUs; i++)
+	cpuBusyTicks[i] = 0;
+    numMigrations = 0;
+    numStackHits = numStackMisses = 0;
+    numRTJobs = numDeadlineMisses = 0;
+    numLockSpins = numSpinAcquires = lockSpinTicks = 0;
 }
 
 //----------------------------------------------------------------------
@@ -38,7 +47,27 @@ Statistics::Print()
     printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, 
 	numConsoleCharsWritten);
-    printf("Paging: faults %d\n", numPageFaults);
+    if (replPolicy != NULL)
+	printf("Paging (%s): faults %d, replacements %d, page-outs %d, "
+	    "copy-on-writes %d\n", replPolicy, numPageFaults, 
+	    numPageReplacements, numPageOuts, numCopyOnWrites);
+    else
+	printf("Paging: faults %d\n", numPageFaults);
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
+    printf("Thread stacks: pooled %d, allocated %d\n", numStackHits,
+	numStackMisses);
+    if (numRTJobs > 0)
+	printf("Real-time jobs: %d, deadline misses %d\n", numRTJobs,
+	    numDeadlineMisses);
+    if (numLockSpins > 0)
+	printf("Lock spinning: spins %d, acquired %d, slept %d, ticks %d\n",
+	    numLockSpins, numSpinAcquires, numLockSpins - numSpinAcquires,
+	    lockSpinTicks);
+    if (numCPUs > 1) {
+	printf("CPUs: %d, migrations %d, busy ticks", numCPUs, numMigrations);
+	for (int i = 0; i < numCPUs; i++)
+	    printf(" %d", cpuBusyTicks[i]);
+	printf("\n");
+    }
 }
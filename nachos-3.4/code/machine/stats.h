@@ -13,6 +13,8 @@
 
 #include "copyright.h"
 
+#define MaxNumCPUs	8	// most simulated CPUs (cf. "-cpus" in main.cc)
+
 // The following class defines the statistics that are to be kept
 // about Nachos behavior -- how much time (ticks) elapsed, how
 // many user instructions executed, etc.
@@ -33,8 +35,30 @@ class Statistics {
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int numPageReplacements;	// number of faults which had to replace
+				// a page already in memory
+    int numPageOuts;		// number of dirty pages written to swap
+				// when they were replaced
+    int numCopyOnWrites;	// number of shared pages copied when
+				// written, after fork
+    const char *replPolicy;	// page replacement policy in use, if any
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
+    int numCPUs;		// number of simulated CPUs
+    int cpuBusyTicks[MaxNumCPUs]; // ticks each CPU spent running threads,
+				// when there are several
+    int numMigrations;		// number of threads moved to another CPU,
+				// by work stealing or load balancing
+    int numStackHits;		// number of thread stacks taken from the
+				// pool of stacks of finished threads
+    int numStackMisses;		// number of thread stacks allocated
+    int numRTJobs;		// number of jobs done by real-time threads
+    int numDeadlineMisses;	// number of those done after their deadline
+    int numLockSpins;		// number of times an adaptive lock spun
+				// waiting for its holder
+    int numSpinAcquires;	// number of those which got the lock,
+				// rather than going to sleep
+    int lockSpinTicks;		// ticks spent spinning
 
     Statistics(); 		// initialize everything to zero
 
@@ -58,4 +82,9 @@ class Statistics {
 #define TimerTicks 	100    	// (average) time between timer interrupts
 #define TimeSlice  1000
 
+#define CPUSwitchTicks	10	// how far ahead of the others a CPU may run,
+				// before the simulation moves to another one
+#define BalanceInterval	(5 * TimeSlice)	// time between load balancing
+				// of the ready queues of the CPUs
+
 #endif // STATS_H
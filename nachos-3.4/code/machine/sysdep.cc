@@ -37,7 +37,9 @@ extern "C" {
 #include <sys/mman.h>
 #ifdef HOST_i386
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <errno.h>
 #endif
 #ifdef HOST_SPARC
@@ -265,6 +267,37 @@ Unlink(char *name)
     return unlink(name);
 }
 
+//----------------------------------------------------------------------
+// LockFile, UnlockFile
+// 	Lock/unlock a whole open file against other UNIX processes (the
+//	lock is not shared with children, unlike that of flock).  Abort
+//	on error.
+//----------------------------------------------------------------------
+
+static void
+FileLockOp(int fd, short type)
+{
+    struct flock fl;
+
+    memset((char *) &fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;		// l_start = l_len = 0: whole file
+    while (fcntl(fd, F_SETLKW, &fl) < 0)
+	ASSERT(errno == EINTR);
+}
+
+void
+LockFile(int fd)
+{
+    FileLockOp(fd, F_WRLCK);
+}
+
+void
+UnlockFile(int fd)
+{
+    FileLockOp(fd, F_UNLCK);
+}
+
 //----------------------------------------------------------------------
 // OpenSocket
 // 	Open an interprocess communication (IPC) connection.  For now, 
@@ -416,6 +449,43 @@ Delay(int seconds)
     (void) sleep((unsigned) seconds);
 }
 
+//----------------------------------------------------------------------
+// HostFork
+// 	Start a UNIX process running a copy of this Nachos, from this
+//	point.  Return 0 in the copy, its process id here.  Pending 
+//	output is flushed first, so that it is not printed twice.
+//----------------------------------------------------------------------
+
+int
+HostFork()
+{
+    int pid;
+
+    fflush(stdout);
+    pid = fork();
+    ASSERT(pid >= 0);
+    return pid;
+}
+
+//----------------------------------------------------------------------
+// HostWait
+// 	Wait for a copy started by HostFork to exit, and return its 
+//	process id, with its exit status in "exitCode" (1 if it was 
+//	killed).  Return -1 if there are no copies left.
+//----------------------------------------------------------------------
+
+int
+HostWait(int *exitCode)
+{
+    int pid, status;
+
+    while ((pid = wait(&status)) < 0 && errno == EINTR)
+	;
+    if (pid >= 0)
+	*exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    return pid;
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
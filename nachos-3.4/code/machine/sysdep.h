@@ -29,6 +29,10 @@ extern int Tell(int fd);
 extern void Close(int fd);
 extern bool Unlink(char *name);
 
+// Lock an open file against other UNIX processes, waiting if need be
+extern void LockFile(int fd);
+extern void UnlockFile(int fd);
+
 // Interprocess communication operations, for simulating the network
 extern int OpenSocket();
 extern void CloseSocket(int sockID);
@@ -43,6 +47,12 @@ extern void Abort();
 extern void Exit(int exitCode);
 extern void Delay(int seconds);
 
+// Start another UNIX process running a copy of this Nachos (0 is
+// returned in the copy), and wait for such a copy to exit.  HostWait 
+// returns -1 once there is none left.
+extern int HostFork();
+extern int HostWait(int *exitCode);
+
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(VoidNoArgFunctionPtr cleanUp);
 
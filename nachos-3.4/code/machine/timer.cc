@@ -39,28 +39,62 @@ static void TimerHandler(int arg)
 //      "callArg" is the parameter to be passed to the interrupt handler.
 //      "doRandom" -- if true, arrange for the interrupts to occur
 //		at random, instead of fixed, intervals.
+//	"doOneShot" -- if true, only interrupt when armed (cf. Arm).
 //----------------------------------------------------------------------
 
-Timer::Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom)
+Timer::Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom,
+	     bool doOneShot)
 {
     randomize = doRandom;
     handler = timerHandler;
     arg = callArg; 
+    oneShot = doOneShot;
+    armed = NULL;
 
     // schedule the first interrupt from the timer device
-    interrupt->Schedule(TimerHandler, (int) this, TimeOfNextInterrupt(), 
+    if (!oneShot)
+	interrupt->Schedule(TimerHandler, (int) this, TimeOfNextInterrupt(),
 		TimerInt); 
 }
 
+//----------------------------------------------------------------------
+// Timer::Arm
+//      Make a one-shot timer interrupt "fromNow" ticks from now, or,
+//	if "fromNow" is 0, not at all.  The interrupt it was armed for
+//	before, if any, is cancelled -- unless it is due at that time.
+//----------------------------------------------------------------------
+
+void
+Timer::Arm(int fromNow)
+{
+    ASSERT(oneShot && fromNow >= 0);
+    if (armed != NULL) {
+	if (fromNow > 0 && armed->when == stats->totalTicks + fromNow)
+	    return;
+	interrupt->Cancel(armed);
+	armed = NULL;
+    }
+    if (fromNow > 0)
+	armed = interrupt->Schedule(TimerHandler, (int) this, fromNow, 
+		TimerInt);
+}
+
 //----------------------------------------------------------------------
 // Timer::TimerExpired
 //      Routine to simulate the interrupt generated by the hardware 
 //	timer device.  Schedule the next interrupt, and invoke the
-//	interrupt handler.
+//	interrupt handler.  A one-shot timer is no longer armed, until
+//	armed again.
 //----------------------------------------------------------------------
 void 
 Timer::TimerExpired() 
 {
+    if (oneShot) {
+	armed = NULL;			// it is deleted once it has occurred
+	(*handler)(arg);
+	return;
+    }
+
     // schedule the next timer device interrupt
     interrupt->Schedule(TimerHandler, (int) this, TimeOfNextInterrupt(), 
 		TimerInt);
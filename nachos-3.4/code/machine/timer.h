@@ -23,14 +23,29 @@
 #include "copyright.h"
 #include "utility.h"
 
+class PendingInterrupt;
+
 // The following class defines a hardware timer. 
+//
+// With "doOneShot", the timer does not tick on its own: it only 
+// interrupts once it has been armed, when the time given to Arm is up.
+// The kernel arms it only when a time slice ends (cf. "-tl" in 
+// main.cc), so no interrupt is simulated while the CPU is idle, or
+// in the middle of a time slice.
+
 class Timer {
   public:
-    Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom);
+    Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom,
+	  bool doOneShot = FALSE);
 				// Initialize the timer, to call the interrupt
 				// handler "timerHandler" every time slice.
     ~Timer() {}
 
+    bool IsOneShot() { return oneShot; }
+    void Arm(int fromNow);	// one-shot: interrupt "fromNow" ticks from
+				// now, instead of when armed before; with
+				// 0, do not interrupt at all
+
 // Internal routines to the timer emulation -- DO NOT call these
 
     void TimerExpired();	// called internally when the hardware
@@ -41,6 +56,9 @@ class Timer {
 
   private:
     bool randomize;		// set if we need to use a random timeout delay
+    bool oneShot;		// interrupt only when armed?
+    PendingInterrupt *armed;	// one-shot: the interrupt it is armed
+				// for, NULL if none
     VoidFunctionPtr handler;	// timer interrupt handler 
     int arg;			// argument to pass to interrupt handler
 
@@ -33,6 +33,9 @@
 #include "machine.h"
 #include "addrspace.h"
 #include "system.h"
+#ifdef INV_PG
+#include "pagerepl.h"
+#endif
 
 // Routines for converting Words and Short Words to and from the
 // simulated machine's format of little endian.  These end up
@@ -121,6 +124,49 @@ Machine::ReadMem(int addr, int size, int *value)
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Machine::FetchInstruction
+//      Fetch the instruction at virtual address "addr", in decoded form.
+//
+//	The instruction stream is read far more often than it changes, so
+//	rather than re-reading and re-decoding every word as it is executed,
+//	we decode a whole page frame the first time any instruction in it is
+//	fetched, and keep the result in "decodeCache" until the frame is
+//	written (cf. WriteMem) or refilled by the kernel (cf.
+//	InvalidateDecoded).  The address translation is still done on every
+//	fetch, so page faults and TLB behavior are exactly as before.
+//
+//   	Returns NULL if the translation step from virtual to physical memory
+//   	failed.
+//
+//	"addr" -- the virtual address of the instruction
+//----------------------------------------------------------------------
+Instruction *
+Machine::FetchInstruction(int addr)
+{
+    ExceptionType exception;
+    int physicalAddress;
+
+    exception = Translate(addr, &physicalAddress, 4, FALSE);
+    if (exception != NoException) {
+		RaiseException(exception, addr);
+		return NULL;
+    }
+
+    int ppn = physicalAddress / PageSize;
+    if (!decodeValid[ppn]) {		// decode the whole page frame
+		DEBUG('a', "Decoding page frame %d\n", ppn);
+		unsigned int *word = (unsigned int *) &mainMemory[ppn * PageSize];
+		Instruction *instr = &decodeCache[ppn * InstrsPerPage];
+		for (int i = 0; i < InstrsPerPage; i++) {
+			instr[i].value = WordToHost(word[i]);
+			instr[i].Decode();
+		}
+		decodeValid[ppn] = TRUE;
+    }
+    return &decodeCache[physicalAddress / 4];
+}
+
 //----------------------------------------------------------------------
 // Machine::WriteMem
 //      Write "size" (1, 2, or 4) bytes of the contents of "value" into
@@ -146,6 +192,7 @@ Machine::WriteMem(int addr, int size, int value)
 		machine->RaiseException(exception, addr);
 		return FALSE;
     }
+    decodeValid[physicalAddress / PageSize] = FALSE; // in case it was code
     switch (size) {
 		case 1:
 		machine->mainMemory[physicalAddress] = (unsigned char) (value & 0xff);
@@ -168,6 +215,147 @@ Machine::WriteMem(int addr, int size, int value)
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Machine::UserSpan
+//      Translate the virtual address "addr", to access "size" bytes
+//	from it, for the kernel.  Like a user instruction would, raise 
+//	the exceptions on the way (e.g. page faults) and try again, until
+//	the translation succeeds.
+//
+//	Return the address of the bytes in mainMemory, and in "spanSize" 
+//	how many of them are in the same page, hence contiguous there.
+//
+//	"addr" -- the virtual address to access
+//	"size" -- the number of bytes to access from there
+//	"writing" -- if TRUE, the bytes are going to be modified
+//	"spanSize" -- the place to store the # of bytes accessible
+//----------------------------------------------------------------------
+char *
+Machine::UserSpan(int addr, int size, bool writing, int *spanSize)
+{
+    ExceptionType exception;
+    int physicalAddress;
+
+    while ((exception = Translate(addr, &physicalAddress, 1, writing))
+							!= NoException)
+		RaiseException(exception, addr);
+    *spanSize = min(size, PageSize - (physicalAddress % PageSize));
+    if (writing)
+		InvalidateDecoded(physicalAddress / PageSize); // in case it was code
+    return &mainMemory[physicalAddress];
+}
+
+//----------------------------------------------------------------------
+// Machine::CopyIn
+//      Copy "size" bytes of virtual memory, starting at "addr", into
+//	the kernel buffer "into".  Each page is translated once, and its
+//	part is copied in one piece.
+//----------------------------------------------------------------------
+void
+Machine::CopyIn(int addr, int size, char *into)
+{
+    int span;
+    char *from;
+
+    DEBUG('a', "Copying in VA 0x%x, size %d\n", addr, size);
+    while (size > 0) {
+		from = UserSpan(addr, size, FALSE, &span);
+		memcpy(into, from, span);
+		addr += span;
+		into += span;
+		size -= span;
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::CopyOut
+//      Copy "size" bytes from the kernel buffer "from" to virtual 
+//	memory, starting at "addr".  Each page is translated once (which
+//	gives it a private copy if it was shared copy-on-write), and its
+//	part is copied in one piece.
+//----------------------------------------------------------------------
+void
+Machine::CopyOut(int addr, int size, char *from)
+{
+    int span;
+    char *into;
+
+    DEBUG('a', "Copying out VA 0x%x, size %d\n", addr, size);
+    while (size > 0) {
+		into = UserSpan(addr, size, TRUE, &span);
+		memcpy(into, from, span);
+		addr += span;
+		from += span;
+		size -= span;
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::CopyInString
+//      Copy the null-terminated string at virtual address "addr" into
+//	the kernel buffer "into", which holds "size" bytes.  Copying 
+//	stops at the null, which is copied too, or when "into" is full.
+//	Return the length of the string, or "size" if it is longer.
+//----------------------------------------------------------------------
+int
+Machine::CopyInString(int addr, int size, char *into)
+{
+    int span, len = 0;
+    char *from, *end;
+
+    while (len < size) {
+		from = UserSpan(addr + len, size - len, FALSE, &span);
+		end = (char *) memchr(from, '\0', span);
+		if (end != NULL) {
+			memcpy(&into[len], from, end - from + 1);
+			return len + (end - from);
+		}
+		memcpy(&into[len], from, span);
+		len += span;
+    }
+    return size;
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushTransCache
+// 	Forget all the vpn -> translation entry hints used by Translate.
+//	The hints are checked on every use, so this is only needed when
+//	a different address space starts running.
+//----------------------------------------------------------------------
+void
+Machine::FlushTransCache()
+{
+    for (int i = 0; i < TransCacheSize; i++)
+		transCache[i] = NULL;
+}
+
+#if defined(USE_TLB) && defined(TLB_LRU)
+//----------------------------------------------------------------------
+// TouchLru
+// 	Make "i" the most recently used element of "lru", an array of
+//	"size" indices ordered from least to most recently used and padded
+//	at the end with -1's (cf. tlb_lru).  "i" must be in it.
+//----------------------------------------------------------------------
+static void
+TouchLru(int *lru, int size, int i)
+{
+    int rear, j = size - 1;
+
+    while (lru[j] == -1) j--;
+    rear = j;
+    if (lru[rear] == i)		// the common case: same page as last time
+		return;
+    for (; j >= 0; j--) {
+		if (lru[j] == i) break;
+    }
+    ASSERT(j >= 0); // must find i in lru
+    for (; j < rear; j++) {
+		lru[j] = lru[j + 1];
+    }
+    lru[rear] = i;
+}
+#endif
+
 //----------------------------------------------------------------------
 // Machine::Translate
 // 	Translate a virtual address into a physical address, using 
@@ -177,6 +365,10 @@ Machine::WriteMem(int addr, int size, int value)
 //	address in "physAddr".  If there was an error, returns the type
 //	of the exception.
 //
+//	The TLB (or inverted page table) entry found for a vpn is 
+//	remembered in transCache, so that repeated accesses to the same 
+//	page don't have to search for it again.
+//
 //	"virtAddr" -- the virtual address to translate
 //	"physAddr" -- the place to store the physical address
 //	"size" -- the amount of memory being read or written
@@ -211,64 +403,42 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 	}
 
 #ifdef USE_TLB // use TLB for translation
-	for (entry = NULL, i = 0; i < TLBSize; i++) // find vpn in TLB
-		if (tlb[i].valid && (tlb[i].virtualPage == vpn)) {
-			entry = &tlb[i];			// FOUND!
-			currentThread->space->tlb_lookup_cnt++;
-#ifdef TLB_LRU // update tlb_lru
-			int rear, j = TLBSize - 1;
-			while (tlb_lru[j] == -1) j--;
-			rear = j;
-			for (; j >= 0; j--) {
-				if (tlb_lru[j] == i) break;
-			}
-			ASSERT(j >= 0); // must find i in tlb_lru
-			if (j != rear) {
-				for (; j < rear; j++) {
-					tlb_lru[j] = tlb_lru[j + 1];
-				}
-				tlb_lru[rear] = i;
+	entry = transCache[vpn % TransCacheSize];
+	if ((entry == NULL) || !entry->valid || (entry->virtualPage != vpn)) {
+		for (entry = NULL, i = 0; i < TLBSize; i++) // find vpn in TLB
+			if (tlb[i].valid && (tlb[i].virtualPage == vpn)) {
+				entry = &tlb[i];			// FOUND!
+				break;
 			}
-#endif // TLB_LRU				
-			break;
+		if (entry == NULL) { // not found
+			DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
+			return PageFaultException; // really, this is a TLB fault,
+						// the page may be in memory,
+						// but not in the TLB
 		}
-	if (entry == NULL) { // not found
-		DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
-		return PageFaultException; // really, this is a TLB fault,
-					// the page may be in memory,
-					// but not in the TLB
+		transCache[vpn % TransCacheSize] = entry;
 	}
+	currentThread->space->tlb_lookup_cnt++;
+#ifdef TLB_LRU // update tlb_lru
+	TouchLru(tlb_lru, TLBSize, entry - tlb);
+#endif // TLB_LRU				
 #endif // USE_TLB
 
 
 #ifndef USE_TLB // use page table for translation (linear or inverted)
 #ifdef INV_PG // use inverted page table.
-	for (entry = NULL, i = 0; i < NumPhysPages; i++)
-		if (invPageTable[i].valid && (invPageTable[i].virtualPage == vpn) && 
-				invPageTable[i].tid == currentThread->getThreadID()) {
-			entry = &invPageTable[i]; // FOUND!
-#ifdef PG_LRU // update pg_lru
-			int rear, j = ResSize - 1;
-			while (currentThread->space->pg_lru[j] == -1) j--;
-			rear = j;
-			for (; j >= 0; j--) {
-				if (currentThread->space->pg_lru[j] == i) break;
-			}
-			ASSERT(j >= 0); // must find i in pg_lru
-			if (j != rear) {
-				for (; j < rear; j++) {
-					currentThread->space->pg_lru[j] = \
-					currentThread->space->pg_lru[j + 1];
-				}
-				currentThread->space->pg_lru[rear] = i;
-			}
-#endif // PG_LRU
-			break;
+	entry = transCache[vpn % TransCacheSize];
+	if ((entry == NULL) || !entry->valid || (entry->virtualPage != vpn) ||
+			(entry->sid != currentSpace)) {
+		i = FindPage(currentSpace, vpn);
+		if (i == -1) {
+			DEBUG('a', "virtual page # %d is not in memory yet!\n", vpn);
+			return PageFaultException;
 		}
-	if (entry == NULL) {
-		DEBUG('a', "virtual page # %d is not in memory yet!\n", vpn);
-		return PageFaultException;
+		entry = &invPageTable[i]; // FOUND!
+		transCache[vpn % TransCacheSize] = entry;
 	}
+	replacer->Touch(entry - invPageTable);
 #else // use normal linear page table.
 	if (!pageTable[vpn].valid) {
 		DEBUG('a', "virtual page # %d is not in memory yet!\n", vpn);
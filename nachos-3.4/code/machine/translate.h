@@ -42,8 +42,8 @@ class TranslationEntry {
 			// page is modified.
 
 #ifdef INV_PG
-    int tid; // thread owning this inverted page table entry.
-            // every thread has a resident set of fixed size ResSize.
+    int sid; // address space owning this inverted page table entry.
+            // (cf. AddrSpace::getSpaceID), -1 if the frame is free
 #endif // INV_PG
 
 };
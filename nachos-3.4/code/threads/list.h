@@ -6,6 +6,9 @@
 //	pending interrupts, etc.  That is why each item is a "void *",
 //	or in other words, a "pointers to anything".
 //
+//	An IntrusiveList holds items of a single type, which carry their
+//	own links: unlike a List, it never allocates memory.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -68,4 +71,167 @@ class List {
     int numInList;		// number of elements in list
 };
 
+// The following classes define an "intrusive" list: rather than a
+// ListElement allocated for each item put on the list, and freed when
+// it is taken off, the links are kept in the items themselves.  So 
+// the list operations never touch the heap, and a given item can be
+// taken off the list in constant time.  The items are of type T, 
+// rather than "void *".
+//
+// An item of type T must have a public member "ListLink<T> link"; so it
+// can be on one intrusive list at a time (e.g. a thread is either on a
+// ready list, or on the wait list of a Semaphore or Condition).
+
+template <class T>
+class ListLink {
+  public:
+    ListLink() { next = prev = NULL; key = 0; inList = FALSE; }
+
+    T *next, *prev;		// neighbours on the list, NULL at the ends
+    int key;			// priority, for a sorted list
+    bool inList;		// is the item on a list?
+};
+
+template <class T>
+class IntrusiveList {
+  public:
+    IntrusiveList() { first = last = NULL; numInList = 0; }
+    ~IntrusiveList() {}		// the items left are not deleted
+
+    void Prepend(T *item);	// Put item at the beginning of the list
+    void Append(T *item);	// Put item at the end of the list
+    T *Remove();		// Take item off the front of the list,
+				// or return NULL if it is empty
+    void Remove(T *item);	// Remove specific item from list
+
+    T *First() { return first; }	// for walking through the list
+    T *Next(T *item) { return item->link.next; }
+    void Mapcar(VoidFunctionPtr func);	// Apply "func" to every item
+    unsigned int NumInList() { return numInList; }
+    bool IsEmpty() { return first == NULL; }
+
+    void SortedInsert(T *item, int sortKey); // after the items with a
+				// key <= sortKey
+    T *SortedRemove(int *keyPtr); // Remove first item, and get its key
+
+  private:
+    void InsertBefore(T *item, T *next); // at the end if "next" is NULL
+
+    T *first;			// Head of the list, NULL if list is empty
+    T *last;			// Last item of list
+    int numInList;		// number of items in list
+};
+
+//----------------------------------------------------------------------
+// IntrusiveList::InsertBefore
+//      Link "item", which is on no list, in before "next" -- or at
+//	the end of the list if "next" is NULL.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+IntrusiveList<T>::InsertBefore(T *item, T *next)
+{
+    ASSERT(!item->link.inList);
+    item->link.inList = TRUE;
+    item->link.next = next;
+    item->link.prev = (next != NULL) ? next->link.prev : last;
+    if (item->link.prev != NULL)
+	item->link.prev->link.next = item;
+    else
+	first = item;
+    if (next != NULL)
+	next->link.prev = item;
+    else
+	last = item;
+    numInList++;
+}
+
+template <class T>
+void
+IntrusiveList<T>::Prepend(T *item)
+{
+    item->link.key = 0;
+    InsertBefore(item, first);
+}
+
+template <class T>
+void
+IntrusiveList<T>::Append(T *item)
+{
+    item->link.key = 0;
+    InsertBefore(item, NULL);
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList::SortedInsert
+//      Insert "item" so that the items stay sorted in increasing order
+//	by key, after those with the same key.  Walk back from the end:
+//	an item is usually inserted at, or near, the end.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+IntrusiveList<T>::SortedInsert(T *item, int sortKey)
+{
+    T *prev = last;
+
+    while (prev != NULL && prev->link.key > sortKey)
+	prev = prev->link.prev;
+    item->link.key = sortKey;
+    InsertBefore(item, (prev != NULL) ? prev->link.next : first);
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList::Remove
+//      Unlink "item", which must be on this list.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+IntrusiveList<T>::Remove(T *item)
+{
+    ASSERT(item->link.inList);
+    if (item->link.prev != NULL)
+	item->link.prev->link.next = item->link.next;
+    else
+	first = item->link.next;
+    if (item->link.next != NULL)
+	item->link.next->link.prev = item->link.prev;
+    else
+	last = item->link.prev;
+    item->link.next = item->link.prev = NULL;
+    item->link.inList = FALSE;
+    numInList--;
+}
+
+template <class T>
+T *
+IntrusiveList<T>::SortedRemove(int *keyPtr)
+{
+    T *item = first;
+
+    if (item == NULL)
+	return NULL;
+    if (keyPtr != NULL)
+	*keyPtr = item->link.key;
+    Remove(item);
+    return item;
+}
+
+template <class T>
+T *
+IntrusiveList<T>::Remove()
+{
+    return SortedRemove(NULL);
+}
+
+template <class T>
+void
+IntrusiveList<T>::Mapcar(VoidFunctionPtr func)
+{
+    for (T *item = first; item != NULL; item = item->link.next)
+	(*func)((int)item);
+}
+
 #endif // LIST_H
@@ -8,8 +8,9 @@
 //
 // 	Most of this file is not needed until later assignments.
 //
-// Usage: nachos -d <debugflags> -rs <random seed #>
-//		-s -x <nachos file> -c <consoleIn> <consoleOut>
+// Usage: nachos -d <debugflags> -rs <random seed #> -sp <policy> -cpus <n>
+//		-ut <user> <tickets> -tl -ls <ticks>
+//		-s -td -pr <policy> -j -x <nachos file> -c <consoleIn> <consoleOut>
 //		-f -cp <unix file> <nachos file>
 //		-p <nachos file> -r <nachos file> -l -D -t
 //              -n <network reliability> -m <machine id>
@@ -18,10 +19,29 @@
 //
 //    -d causes certain debugging messages to be printed (cf. utility.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
+//    -sp chooses the scheduling policy: fifo (default), priority, rr,
+//	mlfq, stride, lottery or edf (cf. threads/schedpolicy.h)
+//    -ut gives a user tickets, for the stride and lottery policies
+//	(DefaultTickets unless set)
+//    -cpus simulates n CPUs (1 by default, at most MaxNumCPUs), each
+//	with its own ready queue (cf. threads/scheduler.h)
+//    -tl makes the timer tickless: rather than every TimerTicks, it only
+//	interrupts when a time slice ends, and never while the CPU is idle
+//	(ignored with -rs, or several CPUs)
+//    -ls sets how many ticks an adaptive lock spins, waiting for its
+//	holder on another CPU, before sleeping (DefaultSpinTicks unless
+//	set, cf. threads/synch.h)
 //    -z prints the copyright message
 //
 //  USER_PROGRAM
 //    -s causes user programs to be executed in single-step mode
+//    -td runs user programs with the threaded-dispatch engine (faster,
+//	same results; ignored with -s or -d m)
+//    -pr chooses the page replacement policy: lru (default), fifo, clock,
+//	esc or wsclock (cf. userprog/pagerepl.h)
+//    -j runs each user program given after it with -x in a UNIX process
+//	of its own, all at once (they share the disk); Nachos exits once
+//	they all have, with status 1 if any failed
 //    -x runs a user program
 //    -c tests the console
 //
@@ -65,6 +85,48 @@ extern void StartProcess(char *filename, char *currWorkDir), ConsoleTest(char *i
 extern void MailTest(int networkID);
 extern void MakeDir(char *name);
 
+#ifdef USER_PROGRAM
+//----------------------------------------------------------------------
+// StartJob
+// 	Run the user program "filename" in a UNIX process of its own, a
+//	copy of this Nachos with its own machine and simulated time, and
+//	return at once.  The copies share the disk, which they lock while
+//	using it.
+//
+//	"job" numbers the copies, from 1.
+//----------------------------------------------------------------------
+static void
+StartJob(char *filename, int job)
+{
+#ifdef FILESYS
+    synchDisk->Share();
+#endif
+    if (HostFork() == 0) {
+        hostJob = job;
+        StartProcess(filename, "/test/");
+        Exit(1);			// could not open "filename"
+    }
+}
+
+//----------------------------------------------------------------------
+// WaitJobs
+// 	Wait for the UNIX processes started by StartJob to exit, and
+//	exit too: with status 1 if any of them failed.
+//----------------------------------------------------------------------
+static void
+WaitJobs()
+{
+    int exitCode, failed = 0;
+
+    while (HostWait(&exitCode) >= 0)
+        if (exitCode != 0)
+            failed++;
+    if (failed > 0)
+        printf("%d user program(s) failed\n", failed);
+    Exit(failed > 0);
+}
+#endif // USER_PROGRAM
+
 //----------------------------------------------------------------------
 // main
 // 	Bootstrap the operating system kernel.  
@@ -84,6 +146,10 @@ main(int argc, char **argv)
 	int _argc;
 	char **_argv;
     int argCount; // the number of arguments for a particular command
+#ifdef USER_PROGRAM
+    bool parallel = FALSE;	// -j: run each program in a UNIX process
+    int numJobs = 0;		// # of UNIX processes started
+#endif
 
     DEBUG('t', "Entering main");
     (void) Initialize(argc, argv);
@@ -115,9 +181,14 @@ main(int argc, char **argv)
         if (!strcmp(*_argv, "-z")) // print copyright
             printf (copyright);
 #ifdef USER_PROGRAM
-        if (!strcmp(*_argv, "-x")) { // run a user program
+        if (!strcmp(*_argv, "-j")) {
+            parallel = TRUE;
+        } else if (!strcmp(*_argv, "-x")) { // run a user program
 	    	ASSERT(_argc > 1);
-            StartProcess(*(_argv + 1), "/test/");
+            if (parallel)
+                StartJob(*(_argv + 1), ++numJobs);
+            else
+                StartProcess(*(_argv + 1), "/test/");
             argCount = 2;
         } else if (!strcmp(*_argv, "-c")) { // test the console
 			if (_argc == 1)
@@ -180,6 +251,11 @@ main(int argc, char **argv)
 #endif // NETWORK
     }
 
+#ifdef USER_PROGRAM
+    if (numJobs > 0)
+        WaitJobs();		// does not return
+#endif
+
     currentThread->Finish();	// NOTE: if the procedure "main" 
 				// returns, then the program "nachos"
 				// will exit (as any other normal program
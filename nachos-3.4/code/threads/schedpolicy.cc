@@ -0,0 +1,549 @@
+// schedpolicy.cc
+//	Routines implementing the scheduling policies.
+//	See schedpolicy.h for an overview.
+//
+// 	These routines assume that interrupts are already disabled
+//	(cf. scheduler.cc).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "schedpolicy.h"
+
+//----------------------------------------------------------------------
+// NewSchedPolicy
+// 	Create the scheduling policy called "name", or return NULL if
+//	there is none.
+//----------------------------------------------------------------------
+SchedPolicy *
+NewSchedPolicy(char *name)
+{
+    if (!strcmp(name, "fifo"))
+		return new FIFOPolicy();
+    if (!strcmp(name, "priority"))
+		return new PriorityPolicy();
+    if (!strcmp(name, "rr"))
+		return new RRPolicy();
+    if (!strcmp(name, "mlfq"))
+		return new MLFQPolicy();
+    if (!strcmp(name, "stride"))
+		return new StridePolicy(FALSE);
+    if (!strcmp(name, "lottery"))
+		return new StridePolicy(TRUE);
+    if (!strcmp(name, "edf"))
+		return new EDFPolicy();
+    return NULL;
+}
+
+// Tickets of the users, shared by the policies of all CPUs.
+static char *ticketUser[MaxShareUsers];
+static int ticketCount[MaxShareUsers];
+static int numTicketUsers = 0;
+
+//----------------------------------------------------------------------
+// SetUserTickets, UserTickets, HasUserTickets
+// 	Set, or get, the tickets of user "uid"; it has DefaultTickets 
+//	unless set otherwise.  HasUserTickets tells if they were set.
+//----------------------------------------------------------------------
+void
+SetUserTickets(char *uid, int tickets)
+{
+    int i;
+
+    ASSERT(tickets >= 1 && tickets <= MaxTickets);
+    for (i = 0; i < numTicketUsers && strcmp(ticketUser[i], uid); i++)
+		;
+    if (i == numTicketUsers) {
+		ASSERT(numTicketUsers < MaxShareUsers);
+		ticketUser[numTicketUsers++] = uid;
+    }
+    ticketCount[i] = tickets;
+}
+
+static int
+UserTickets(char *uid)
+{
+    for (int i = 0; i < numTicketUsers; i++)
+		if (!strcmp(ticketUser[i], uid))
+			return ticketCount[i];
+    return DefaultTickets;
+}
+
+static bool
+HasUserTickets(char *uid)
+{
+    for (int i = 0; i < numTicketUsers; i++)
+		if (!strcmp(ticketUser[i], uid))
+			return TRUE;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// FIFOPolicy::Add
+// 	Put "thread" at the end of the ready list, or at the front if
+//	"prepend".
+//----------------------------------------------------------------------
+void
+FIFOPolicy::Add(Thread *thread, bool prepend)
+{
+    if (prepend)
+		readyList.Prepend(thread);
+    else
+		readyList.Append(thread);
+}
+
+//----------------------------------------------------------------------
+// FIFOPolicy::Print
+// 	Print the ready list, in order.
+//----------------------------------------------------------------------
+void
+FIFOPolicy::Print()
+{
+    readyList.Mapcar((VoidFunctionPtr) ThreadPrint);
+}
+
+//----------------------------------------------------------------------
+// FirstSet
+// 	Return the index of the lowest bit set in "word", which is not 0.
+//----------------------------------------------------------------------
+static inline int
+FirstSet(unsigned int word)
+{
+#ifdef __GNUC__
+    return __builtin_ctz(word);
+#else
+    int i;
+
+    for (i = 0; !(word & 1); i++)
+		word >>= 1;
+    return i;
+#endif
+}
+
+//----------------------------------------------------------------------
+// RunQueues::RunQueues
+// 	Initialize the lists of all priorities to empty.
+//----------------------------------------------------------------------
+RunQueues::RunQueues()
+{
+    for (int i = 0; i < PriMapWords; i++)
+		nonEmpty[i] = 0;
+}
+
+//----------------------------------------------------------------------
+// RunQueues::Add
+// 	Put "thread" at the end of the list of priority "pri", or at the
+//	front if "prepend", and mark that list as non-empty.
+//----------------------------------------------------------------------
+void
+RunQueues::Add(Thread *thread, int pri, bool prepend)
+{
+    ASSERT(pri >= 0 && pri < NumPriLevels);
+    if (prepend)
+		queue[pri].Prepend(thread);
+    else
+		queue[pri].Append(thread);
+    nonEmpty[pri / PriMapBits] |= 1u << (pri % PriMapBits);
+}
+
+//----------------------------------------------------------------------
+// RunQueues::Remove
+// 	Find the highest non-empty priority with the bitmap, and dequeue
+//	the first thread of its list.  Return NULL if all are empty.
+//----------------------------------------------------------------------
+Thread *
+RunQueues::Remove()
+{
+    Thread *thread;
+    int i, pri;
+
+    for (i = 0; i < PriMapWords && nonEmpty[i] == 0; i++)
+		;
+    if (i == PriMapWords)
+		return NULL;
+    pri = i * PriMapBits + FirstSet(nonEmpty[i]);
+    thread = queue[pri].Remove();
+    if (queue[pri].IsEmpty())
+		nonEmpty[i] &= ~(1u << (pri % PriMapBits));
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// RunQueues::Remove
+// 	Dequeue "thread" from the list of priority "pri", wherever it is
+//	in the list.
+//----------------------------------------------------------------------
+void
+RunQueues::Remove(Thread *thread, int pri)
+{
+    queue[pri].Remove(thread);
+    if (queue[pri].IsEmpty())
+		nonEmpty[pri / PriMapBits] &= ~(1u << (pri % PriMapBits));
+}
+
+//----------------------------------------------------------------------
+// RunQueues::Print
+// 	Print the non-empty lists, from the highest priority down.
+//----------------------------------------------------------------------
+void
+RunQueues::Print()
+{
+    for (int i = 0; i < NumPriLevels; i++) {
+		if (queue[i].IsEmpty())
+			continue;
+		printf("[%d] ", i);
+		queue[i].Mapcar((VoidFunctionPtr) ThreadPrint);
+    }
+}
+
+//----------------------------------------------------------------------
+// MLFQPolicy::TimerExpired
+// 	On a timer interrupt, boost the threads of this CPU if it is 
+//	time to.
+//	Then, if "running" has used up the time slice of its level, move
+//	it one level down (unless it is at the bottom), and have it yield.
+//----------------------------------------------------------------------
+bool
+MLFQPolicy::TimerExpired(Thread *running)
+{
+    int now = stats->totalTicks, level = running->getLevel();
+
+    if (now - lastBoost >= BoostInterval)
+		Boost(running->getCPU());
+    if (running->RunningTime(now) < Quantum(level))
+		return FALSE;
+    if (level < NumPriLevels - 1)
+		running->setLevel(level + 1);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// MLFQPolicy::Boost
+// 	Move every thread of "cpu", ready or not, to the top level.  The
+//	ready ones are queued level by level, so that they keep their 
+//	order.
+//
+//	With "-cpus", each CPU has its own policy, which boosts only the
+//	threads it owns: those in its queues, running on it, or which 
+//	last ran on it (cf. Thread::getCPU).  The threads of the other 
+//	CPUs are left to their own policy, so that their level always
+//	matches the queue they are on.
+//----------------------------------------------------------------------
+void
+MLFQPolicy::Boost(int cpu)
+{
+    IntrusiveList<Thread> ready;
+    Thread *thread;
+
+    DEBUG('t', "Boosting all threads of CPU %d to the top level.\n", cpu);
+    lastBoost = stats->totalTicks;
+    for (int i = 0; i < Thread::table.Size(); i++) {
+		thread = Thread::table.Get(i);
+		if (thread != NULL && thread->getCPU() == cpu)
+			thread->setLevel(0);
+    }
+    while ((thread = queues.Remove()) != NULL)
+		ready.Append(thread);
+    while ((thread = ready.Remove()) != NULL)
+		queues.Add(thread, 0, FALSE);
+}
+
+//----------------------------------------------------------------------
+// StridePolicy::StridePolicy
+// 	No user is known yet.
+//----------------------------------------------------------------------
+StridePolicy::StridePolicy(bool useLottery)
+{
+    lottery = useLottery;
+    users = new ShareUser[ShareUsersInit];
+    numUsers = 0;
+    maxUsers = ShareUsersInit;
+    globalPass = 0;
+}
+
+StridePolicy::~StridePolicy()
+{
+    for (int i = 0; i < numUsers; i++)
+		delete users[i].ready;
+    delete [] users;
+}
+
+//----------------------------------------------------------------------
+// StridePolicy::Find
+// 	Return the entry of user "uid", or NULL if it has none.
+//----------------------------------------------------------------------
+StridePolicy::ShareUser *
+StridePolicy::Find(char *uid)
+{
+    for (int i = 0; i < numUsers; i++)
+		if (!strcmp(users[i].uid, uid))
+			return &users[i];
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// StridePolicy::User
+// 	Return the entry of user "uid", adding it if need be.  A new user
+//	takes over the entry of one with no ready thread and no tickets
+//	set, if any: a user coming back with nothing ready starts at 
+//	globalPass anyway.  Otherwise the table is doubled.
+//----------------------------------------------------------------------
+StridePolicy::ShareUser *
+StridePolicy::User(char *uid)
+{
+    ShareUser *user = Find(uid);
+    int i;
+
+    if (user != NULL)
+		return user;
+    for (i = 0; i < numUsers; i++)
+		if (users[i].ready->IsEmpty() && !HasUserTickets(users[i].uid))
+			break;
+    if (i == numUsers) {
+		if (numUsers == maxUsers) {
+			ShareUser *newUsers = new ShareUser[2 * maxUsers];
+
+			for (i = 0; i < numUsers; i++)
+				newUsers[i] = users[i];
+			delete [] users;
+			users = newUsers;
+			maxUsers *= 2;
+		}
+		users[i].ready = new IntrusiveList<Thread>;
+		numUsers++;
+    }
+    users[i].uid = uid;
+    users[i].pass = globalPass;
+    users[i].threadPass = 0;
+    return &users[i];
+}
+
+//----------------------------------------------------------------------
+// StridePolicy::Add
+// 	Queue "thread" with the other ready threads of its user.  A user
+//	or thread coming back from being blocked starts at the pass of
+//	the last one to run, if it is behind.
+//----------------------------------------------------------------------
+void
+StridePolicy::Add(Thread *thread, bool prepend)
+{
+    ShareUser *user = User(thread->getUserID());
+
+    if (lottery) {
+		if (prepend)
+			user->ready->Prepend(thread);
+		else
+			user->ready->Append(thread);
+		return;
+    }
+    if (user->ready->IsEmpty())
+		user->pass = max(user->pass, globalPass);
+    // a thread which last ran with another CPU's policy, or before
+    // a rebase, may be far ahead: bring it back
+    thread->setPass(min(max(thread->getPass(), user->threadPass),
+			user->threadPass + MaxPassLead));
+    user->ready->SortedInsert(thread, thread->getPass());
+}
+
+//----------------------------------------------------------------------
+// StridePolicy::Remove
+// 	Stride: take the user with the smallest pass, and its thread with
+//	the smallest pass.  Lottery: draw a user in proportion to its 
+//	tickets, then one of its threads.  Return NULL if none is ready.
+//----------------------------------------------------------------------
+Thread *
+StridePolicy::Remove()
+{
+    ShareUser *user = NULL;
+    int i, pass, total = 0;
+    Thread *thread;
+
+    for (i = 0; i < numUsers; i++) {
+		if (users[i].ready->IsEmpty())
+			continue;
+		total += UserTickets(users[i].uid);
+		if (user == NULL || users[i].pass < user->pass)
+			user = &users[i];
+    }
+    if (user == NULL)
+		return NULL;
+
+    if (lottery) {
+		total = Random() % total;
+		for (i = 0; ; i++) {
+			if (users[i].ready->IsEmpty())
+				continue;
+			if (total < UserTickets(users[i].uid))
+				break;
+			total -= UserTickets(users[i].uid);
+		}
+		return Draw(users[i].ready);
+    }
+
+    thread = user->ready->SortedRemove(&pass);
+    globalPass = user->pass;
+    user->threadPass = pass;
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// StridePolicy::Draw
+// 	Draw one of the threads of "ready", in proportion to its tickets,
+//	and remove it.
+//----------------------------------------------------------------------
+Thread *
+StridePolicy::Draw(IntrusiveList<Thread> *ready)
+{
+    int total = 0;
+    Thread *thread;
+
+    for (thread = ready->First(); thread != NULL; thread = ready->Next(thread))
+		total += thread->getTickets();
+    total = Random() % total;
+    for (thread = ready->First(); ; thread = ready->Next(thread)) {
+		if (total < thread->getTickets() || ready->Next(thread) == NULL)
+			break;
+		total -= thread->getTickets();
+    }
+    ready->Remove(thread);
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// StridePolicy::Stopped
+// 	Stride: charge "thread", and its user, for the ticks it has just
+//	run: their stride for each TimeSlice.  Rebase the passes if they
+//	are getting too large.
+//----------------------------------------------------------------------
+void
+StridePolicy::Stopped(Thread *thread)
+{
+    ShareUser *user;
+    int used;
+
+    if (lottery)
+		return;
+    user = User(thread->getUserID());
+    used = min(thread->RunningTime(stats->totalTicks), MaxCharge);
+    thread->setPass(thread->getPass() + 
+			(StrideOne / thread->getTickets()) * used / TimeSlice);
+    user->pass += (StrideOne / UserTickets(user->uid)) * used / TimeSlice;
+    if (user->pass >= PassRebase || thread->getPass() >= PassRebase)
+		Rebase(thread->getCPU());
+}
+
+//----------------------------------------------------------------------
+// StridePolicy::Rebase
+// 	Subtract globalPass from the pass of every user, and the pass of
+//	the last thread to run of each user from the passes of its 
+//	threads: those ready here, running on "cpu" or which last ran on
+//	it.  A pass which was behind becomes 0, as it would be brought 
+//	up to that when it gets ready anyway.  Ready threads are all at
+//	or past the pass of their user's last thread, so they keep their
+//	order in the lists.
+//----------------------------------------------------------------------
+void
+StridePolicy::Rebase(int cpu)
+{
+    ShareUser *user;
+    Thread *thread;
+    int i;
+
+    DEBUG('t', "Rebasing stride passes, by %d for the users.\n", globalPass);
+    for (i = 0; i < Thread::table.Size(); i++) {
+		thread = Thread::table.Get(i);
+		if (thread == NULL || thread->getCPU() != cpu)
+			continue;
+		user = Find(thread->getUserID());
+		thread->setPass((user == NULL) ? 0 :
+				max(thread->getPass() - user->threadPass, 0));
+		if (thread->getStatus() == READY)	// on user->ready
+			thread->link.key = thread->getPass();
+    }
+    for (i = 0; i < numUsers; i++) {
+		users[i].pass = max(users[i].pass - globalPass, 0);
+		users[i].threadPass = 0;
+    }
+    globalPass = 0;
+}
+
+//----------------------------------------------------------------------
+// StridePolicy::Print
+// 	Print the ready threads of each user.
+//----------------------------------------------------------------------
+void
+StridePolicy::Print()
+{
+    for (int i = 0; i < numUsers; i++) {
+		if (users[i].ready->IsEmpty())
+			continue;
+		printf("[%s] ", users[i].uid);
+		users[i].ready->Mapcar((VoidFunctionPtr) ThreadPrint);
+    }
+}
+
+//----------------------------------------------------------------------
+// EDFPolicy::Add
+// 	Queue a real-time thread by its deadline, after those with the 
+//	same deadline -- or, if "prepend", before them.  The others go
+//	on the round robin list.
+//----------------------------------------------------------------------
+void
+EDFPolicy::Add(Thread *thread, bool prepend)
+{
+    if (!thread->isRealTime())
+		FIFOPolicy::Add(thread, prepend);
+    else if (prepend)
+		rtList.SortedInsert(thread, thread->getDeadline() - 1);
+    else
+		rtList.SortedInsert(thread, thread->getDeadline());
+}
+
+//----------------------------------------------------------------------
+// EDFPolicy::Remove
+// 	Dequeue the real-time thread with the earliest deadline, if any,
+//	or else the first of the others.
+//----------------------------------------------------------------------
+Thread *
+EDFPolicy::Remove()
+{
+    if (!rtList.IsEmpty())
+		return rtList.Remove();
+    return FIFOPolicy::Remove();
+}
+
+//----------------------------------------------------------------------
+// EDFPolicy::Preempts, YieldsTo
+// 	A real-time thread goes before any other thread, and before a
+//	real-time thread with a later deadline.
+//----------------------------------------------------------------------
+bool
+EDFPolicy::Preempts(Thread *ready, Thread *running)
+{
+    if (!ready->isRealTime())
+		return FALSE;
+    return !running->isRealTime() || 
+		ready->getDeadline() < running->getDeadline();
+}
+
+bool
+EDFPolicy::YieldsTo(Thread *next, Thread *running)
+{
+    if (!running->isRealTime())
+		return TRUE;
+    return next->isRealTime() && 
+		next->getDeadline() <= running->getDeadline();
+}
+
+//----------------------------------------------------------------------
+// EDFPolicy::Print
+// 	Print the ready real-time threads, then the others.
+//----------------------------------------------------------------------
+void
+EDFPolicy::Print()
+{
+    rtList.Mapcar((VoidFunctionPtr) ThreadPrint);
+    FIFOPolicy::Print();
+}
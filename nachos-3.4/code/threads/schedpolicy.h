@@ -0,0 +1,315 @@
+// schedpolicy.h
+//	Data structures for the scheduling policies: which ready thread
+//	runs next, and when the running thread must give up the CPU.
+//
+//	The Scheduler keeps the ready threads in its policy, and asks
+//	the policy whether a thread becoming ready preempts the running
+//	one, whether a yielding thread really lets the next one run, and,
+//	on each timer interrupt, whether the running thread has used up
+//	its time slice.
+//
+//	The policy is chosen when Nachos starts (cf. "-sp" in main.cc):
+//	    fifo	first come, first served (the default); the timer
+//			only switches threads with "-rs"
+//	    priority	preemptive, by Thread::getPriority (0 is the
+//			highest), FIFO within a priority; a thread
+//			holding a lock runs at the priority of the
+//			highest thread waiting for it (cf. Lock)
+//	    rr		round robin, TimeSlice ticks each
+//	    mlfq	multi-level feedback queue: a queue per level, the
+//			lower levels with longer time slices; a thread
+//			using up its slice moves one level down, and
+//			every BoostInterval ticks all go back to the top
+//	    stride	proportional share: the CPU is divided between
+//			the users with ready threads in proportion to
+//			their tickets (cf. "-ut" in main.cc), and the
+//			share of a user between its threads in proportion
+//			to theirs (cf. Thread::setTickets)
+//	    lottery	the same shares, drawn at random
+//	    edf		earliest deadline first for the real-time threads
+//			(cf. Thread::SetRealTime), which come before all
+//			the others; those run round robin
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SCHEDPOLICY_H
+#define SCHEDPOLICY_H
+
+#include "copyright.h"
+#include "list.h"
+#include "system.h"
+
+#define BoostInterval	(20 * TimeSlice) // (ticks) how often mlfq puts
+					// every thread back in the top level
+#define MaxQuantumShift	8		// the time slice of mlfq doubles 
+					// from one level to the next, up to
+					// (TimeSlice << MaxQuantumShift)
+
+#define StrideOne	(1 << 14)	// stride of a single ticket
+#define MaxCharge	(16 * TimeSlice) // most ticks charged for one run
+#define MaxShareUsers	32		// most users with tickets set
+#define ShareUsersInit	8		// # of users a policy has room for
+					// at first; the table doubles
+#define MaxPassLead	(StrideOne * (MaxCharge / TimeSlice))
+					// most a ready thread can be ahead
+					// of the pass of its user's last 
+					// thread to run: one charge, with a
+					// single ticket
+#define PassRebase	(1 << 28)	// passes are brought back down 
+					// before they get past this
+
+#define PriMapBits	32		// # of bits in each word of the
+					// bitmap of RunQueues
+#define PriMapWords	divRoundUp(NumPriLevels, PriMapBits)
+
+// The following class keeps ready threads in a FIFO list per priority
+// level (0 is the highest), with a bitmap of the non-empty lists.
+// Adding a thread, and finding the first thread of the highest 
+// priority, take constant time however many threads are ready.
+
+class RunQueues {
+  public:
+    RunQueues();			// all lists are empty
+
+    void Add(Thread *thread, int pri, bool prepend);
+					// put "thread" at the end (or the
+					// front) of the list of "pri"
+    Thread *Remove();			// dequeue the first thread of the
+					// highest priority, or NULL
+    void Remove(Thread *thread, int pri); // dequeue "thread", which is
+					// on the list of "pri"
+    void Print();			// print the lists, highest first
+
+  private:
+    IntrusiveList<Thread> queue[NumPriLevels]; // ready threads, per
+					// priority
+    unsigned int nonEmpty[PriMapWords];	// bit i set iff queue[i] is not
+					// empty
+};
+
+// The following class defines the interface of a scheduling policy.
+
+class SchedPolicy {
+  public:
+    virtual ~SchedPolicy() {}
+
+    virtual const char *Name() = 0;	// the name used with "-sp"
+    virtual void Add(Thread *thread, bool prepend) = 0;
+					// "thread" is ready to run; with
+					// "prepend", it goes before the
+					// threads of the same rank
+    virtual Thread *Remove() = 0;	// dequeue the next thread to run,
+					// or return NULL if there is none
+    virtual void Print() = 0;		// print the ready threads
+    virtual void Reprioritize(Thread *thread, int oldPri) {}
+					// "thread", ready, has changed
+					// priority from "oldPri"
+
+    virtual bool Preempts(Thread *ready, Thread *running)
+		{ return FALSE; }	// should "ready", just added,
+					// run instead of "running"?
+    virtual bool YieldsTo(Thread *next, Thread *running)
+		{ return TRUE; }	// should "running", yielding, let
+					// "next" run?  If not, next goes
+					// back to the front of the queue
+    virtual void Dispatched(Thread *thread)
+		{ thread->RecordTime(stats->totalTicks); }
+					// "thread" starts, or goes on,
+					// running for a new time slice
+    virtual void Stopped(Thread *thread) {}
+					// "thread" stops running for now:
+					// it yields, blocks or finishes
+    virtual bool TimerExpired(Thread *running)
+		{ return TRUE; }	// on a timer interrupt: should
+					// "running" yield?
+    virtual bool NeedsTimer() { return FALSE; }
+					// are there time slices at all?
+    virtual int SliceLeft(Thread *running) { return 0; }
+					// ticks until "running" may have to
+					// yield, or 0 if it need not; a
+					// tickless timer is armed for then
+};
+
+// Return a new scheduling policy "name", or NULL if there is no such
+// policy.
+extern SchedPolicy *NewSchedPolicy(char *name);
+
+// Give "tickets" tickets to user "uid", for the stride and lottery 
+// policies.
+extern void SetUserTickets(char *uid, int tickets);
+
+// First come, first served: a single FIFO ready list.
+
+class FIFOPolicy : public SchedPolicy {
+  public:
+    const char *Name() { return "fifo"; }
+    void Add(Thread *thread, bool prepend);
+    Thread *Remove() { return readyList.Remove(); }
+    void Print();
+
+  protected:
+    IntrusiveList<Thread> readyList;	// threads ready to run
+};
+
+// Preemptive priority: a FIFO ready list per priority.
+
+class PriorityPolicy : public SchedPolicy {
+  public:
+    const char *Name() { return "priority"; }
+    void Add(Thread *thread, bool prepend)
+		{ queues.Add(thread, thread->getPriority(), prepend); }
+    Thread *Remove() { return queues.Remove(); }
+    void Print() { queues.Print(); }
+    void Reprioritize(Thread *thread, int oldPri)
+		{ queues.Remove(thread, oldPri);
+		  queues.Add(thread, thread->getPriority(), FALSE); }
+    bool Preempts(Thread *ready, Thread *running)
+		{ return ready->getPriority() < running->getPriority(); }
+    bool YieldsTo(Thread *next, Thread *running)
+		{ return next->getPriority() <= running->getPriority(); }
+
+  private:
+    RunQueues queues;			// the ready threads
+};
+
+// Round robin: FIFO, and a thread yields after TimeSlice ticks.
+
+class RRPolicy : public FIFOPolicy {
+  public:
+    const char *Name() { return "rr"; }
+    bool TimerExpired(Thread *running)
+		{ return running->RunningTime(stats->totalTicks) >= TimeSlice; }
+    bool NeedsTimer() { return TRUE; }
+    int SliceLeft(Thread *running)
+		{ return max(1, TimeSlice - 
+			running->RunningTime(stats->totalTicks)); }
+};
+
+// Multi-level feedback queue, with NumPriLevels levels; level 0 is
+// the top.  A new thread starts at the top.  A thread which blocks
+// before its time slice is over (e.g. waiting for the console) stays
+// at its level, so interactive threads keep short response times;
+// one which keeps computing sinks to the bottom.  The periodic boost
+// makes sure that those still get the CPU now and then.
+
+class MLFQPolicy : public SchedPolicy {
+  public:
+    MLFQPolicy() { lastBoost = 0; }
+
+    const char *Name() { return "mlfq"; }
+    void Add(Thread *thread, bool prepend)
+		{ queues.Add(thread, thread->getLevel(), prepend); }
+    Thread *Remove() { return queues.Remove(); }
+    void Print() { queues.Print(); }
+
+    bool Preempts(Thread *ready, Thread *running)
+		{ return ready->getLevel() < running->getLevel(); }
+    bool YieldsTo(Thread *next, Thread *running)
+		{ return next->getLevel() <= running->getLevel(); }
+    bool TimerExpired(Thread *running);
+    bool NeedsTimer() { return TRUE; }
+    int SliceLeft(Thread *running)
+		{ return max(1, Quantum(running->getLevel()) - 
+			running->RunningTime(stats->totalTicks)); }
+
+  private:
+    int Quantum(int level) 
+		{ return TimeSlice << min(level, MaxQuantumShift); }
+					// time slice at each level
+    void Boost(int cpu);		// move every thread of "cpu" to
+					// the top
+
+    RunQueues queues;			// ready threads, per level
+    int lastBoost;			// stats->totalTicks at the last Boost
+};
+
+// Stride scheduling, or lottery scheduling with "lottery", at two
+// levels: first a user, then one of its threads.  With stride, each
+// user and thread has a "pass", which goes up by its stride (StrideOne
+// divided by its tickets) for each time slice it runs -- in proportion
+// to the ticks it actually ran.  The user with the smallest pass runs,
+// and of its ready threads, the one with the smallest pass.  A user or
+// thread which was not ready does not bank its share: it comes back 
+// with at least the pass of the last one to run.  With lottery, a user
+// and a thread are drawn instead, each in proportion to its tickets.
+//
+// Passes only grow, and faster than the clock, so they are rebased 
+// once they reach PassRebase: the users' by the pass of the last user
+// to run, and the threads' of each user by the pass of its last thread
+// to run.  Only the differences between them matter.
+//
+// The running thread is preempted once it has used up TimeSlice.
+
+class StridePolicy : public SchedPolicy {
+  public:
+    StridePolicy(bool useLottery);
+    ~StridePolicy();
+
+    const char *Name() { return lottery ? "lottery" : "stride"; }
+    void Add(Thread *thread, bool prepend);
+    Thread *Remove();
+    void Print();
+    void Stopped(Thread *thread);
+    bool TimerExpired(Thread *running)
+		{ return running->RunningTime(stats->totalTicks) >= TimeSlice; }
+    bool NeedsTimer() { return TRUE; }
+    int SliceLeft(Thread *running)
+		{ return max(1, TimeSlice - 
+			running->RunningTime(stats->totalTicks)); }
+
+  private:
+    struct ShareUser {
+	char *uid;			// user id, cf. Thread::getUserID
+	int pass;			// stride: virtual time of the user
+	int threadPass;			// pass of its last thread to run
+	IntrusiveList<Thread> *ready;	// its ready threads (stride: sorted
+					// by pass)
+    };
+
+    ShareUser *Find(char *uid);		// find user "uid", or NULL
+    ShareUser *User(char *uid);		// find (or add) user "uid"
+    void Rebase(int cpu);		// bring the passes of the threads
+					// of "cpu", and of the users, down
+    Thread *Draw(IntrusiveList<Thread> *ready);
+					// lottery: draw a thread
+
+    bool lottery;			// draw, rather than stride?
+    ShareUser *users;			// users seen, with or without
+					// ready threads
+    int numUsers;			// # of entries in use in "users"
+    int maxUsers;			// # of entries in "users"
+    int globalPass;			// pass of the last user to run
+};
+
+// Earliest deadline first, for real-time threads, on top of round
+// robin for the others.  A ready real-time thread always runs before
+// the others, and preempts a running one; among real-time threads,
+// the one whose job is due first runs, and is not time sliced -- it
+// runs until its job is done, or one due earlier is released.  The
+// admission test of Thread::SetRealTime keeps the real-time threads
+// from needing more than the CPU; the other threads get what is left.
+
+class EDFPolicy : public RRPolicy {
+  public:
+    const char *Name() { return "edf"; }
+    void Add(Thread *thread, bool prepend);
+    Thread *Remove();
+    void Print();
+
+    bool Preempts(Thread *ready, Thread *running);
+    bool YieldsTo(Thread *next, Thread *running);
+    bool TimerExpired(Thread *running)
+		{ return !running->isRealTime() && 
+			RRPolicy::TimerExpired(running); }
+    int SliceLeft(Thread *running)
+		{ return running->isRealTime() ? 0 : 
+			RRPolicy::SliceLeft(running); }
+
+  private:
+    IntrusiveList<Thread> rtList;	// ready real-time threads, sorted
+					// by deadline
+};
+
+#endif // SCHEDPOLICY_H
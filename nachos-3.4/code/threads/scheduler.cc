@@ -4,15 +4,20 @@
 //
 // 	These routines assume that interrupts are already disabled.
 //	If interrupts are disabled, we can assume mutual exclusion
-//	(since we are on a uniprocessor).
+//	(since the simulated CPUs only take turns while interrupts are
+//	enabled, cf. Scheduler::Interleave).
 //
 // 	NOTE: We can't use Locks to provide mutual exclusion here, since
 // 	if we needed to wait for a lock, and the lock was busy, we would 
 //	end up calling FindNextToRun(), and that would put us in an 
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
-//	Might need to be improved in later assignments.
+// 	Which ready thread runs next is decided by the scheduling policy
+//	chosen at startup (cf. schedpolicy.h).  With several CPUs, each
+//	has its own ready queue; a thread goes back to the CPU it last
+//	ran on, a CPU with nothing to run steals a thread from the
+//	busiest one, and every BalanceInterval ticks the queues are
+//	evened out.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -20,66 +25,118 @@
 
 #include "copyright.h"
 #include "scheduler.h"
+#include "schedpolicy.h"
 #include "system.h"
 
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
-// 	Initialize the list of ready but not running threads to empty.
+// 	Initialize the lists of ready but not running threads to empty.
+//
+//	"schedPolicies" are the scheduling policies of the "nCPUs" CPUs,
+//	which keep their ready threads (cf. NewSchedPolicy).  The thread
+//	running now is on CPU 0; the others are idle.
 //----------------------------------------------------------------------
 
-Scheduler::Scheduler()
+Scheduler::Scheduler(SchedPolicy **schedPolicies, int nCPUs)
 { 
-    readyList = new List; 
+    ASSERT(nCPUs >= 1 && nCPUs <= MaxNumCPUs);
+    numCPUs = nCPUs;
+    cpu = 0;
+    for (int i = 0; i < numCPUs; i++) {
+	policy[i] = schedPolicies[i];
+	numReady[i] = 0;
+	running[i] = NULL;
+	localTime[i] = 0;
+	needResched[i] = FALSE;
+    }
+    lastBalance = 0;
+    keptRunning = FALSE;
 } 
 
 //----------------------------------------------------------------------
 // Scheduler::~Scheduler
-// 	De-allocate the list of ready threads.
+// 	De-allocate the lists of ready threads.
 //----------------------------------------------------------------------
 
 Scheduler::~Scheduler()
 { 
-    delete readyList; 
+    for (int i = 0; i < numCPUs; i++)
+	delete policy[i]; 
 } 
 
 //----------------------------------------------------------------------
 // Scheduler::ReadyToRun
 // 	Mark a thread as ready, but not running.
 //	Put it on the ready list, for later scheduling onto the CPU.
+//	A thread goes back to the CPU it last ran on, whose cache
+//	would still hold its data; a new one to the least loaded CPU.
 //
 //	"thread" is the thread to be put on the ready list.
-//  If "prepend" is true, send thread to the front of readyList.
+//  If "prepend" is true, send thread to the front of readyList
+//  of the current CPU.
 //----------------------------------------------------------------------
 
 void
 Scheduler::ReadyToRun (Thread *thread, bool prepend)
 {
-    DEBUG('t', "Putting thread \"%s\" on ready list.\n", thread->getName());
+    int c = cpu;
+
+    if (!prepend && numCPUs > 1)
+	c = (thread->getCPU() >= 0) ? thread->getCPU() : LeastLoaded();
+
+    DEBUG('t', "Putting thread \"%s\" on ready list of CPU %d.\n", 
+	  thread->getName(), c);
 
     thread->setStatus(READY);
+    thread->setCPU(c);
+    policy[c]->Add(thread, prepend);
+    numReady[c]++;
 
-    if (prepend) {
-        readyList->Prepend((void *)thread);
-    } else {
-#ifdef SCHED_PRI_PRMPT
-        readyList->SortedInsert((void *)thread, thread->getPriority());
-        // Since this is a preemptive policy, we should check here whether
-        // the newly inserted thread is to take preemption. Pay attention that
-        // there is no need to worry about infinite loop of calling each other
-        // between scheduler->ReadyToRun and currentThread->Yield, since the
-        // condition in the "if" statement will never satisfy in that case.
-        if (thread->getPriority() < currentThread->getPriority())
+    // With a preemptive policy, we should check here whether the newly 
+    // inserted thread is to take preemption. Pay attention that there is
+    // no need to worry about infinite loop of calling each other between
+    // scheduler->ReadyToRun and currentThread->Yield, since the policy
+    // never lets a thread preempt itself.  In an interrupt handler, the
+    // interrupted thread yields once the handler is done.  The thread
+    // of another CPU yields once that CPU runs again.
+    if (prepend)
+	return;
+    if (c != cpu) {
+	if (running[c] != NULL && policy[c]->Preempts(thread, running[c]))
+	    needResched[c] = TRUE;
+    } else if (policy[c]->Preempts(thread, currentThread)) {
+        if (interrupt->inInterruptHandler())
+            interrupt->YieldOnReturn();
+        else
             currentThread->Yield();
-#else // SCHED_NAIVE, SCHED_RR
-        readyList->Append((void *)thread);
-#endif
     }
 }
 
+//----------------------------------------------------------------------
+// Scheduler::Reprioritize
+// 	The priority of "thread", ready on the CPU it is queued on, has
+//	changed from "oldPri": let the policy of that CPU move it, and
+//	check whether it now preempts the running thread of another CPU.
+//	(The current thread is about to block, or has just lowered its
+//	own priority and will be preempted by the waiter it wakes up.)
+//----------------------------------------------------------------------
+
+void
+Scheduler::Reprioritize (Thread *thread, int oldPri)
+{
+    int c = thread->getCPU();
+
+    policy[c]->Reprioritize(thread, oldPri);
+    if (c != cpu && running[c] != NULL && 
+			policy[c]->Preempts(thread, running[c]))
+	needResched[c] = TRUE;
+}
+
 //----------------------------------------------------------------------
 // Scheduler::FindNextToRun
-// 	Return the next thread to be scheduled onto the CPU.
-//	If there are no ready threads, return NULL.
+// 	Return the next thread to be scheduled onto the current CPU.
+//	If it has no ready threads, steal one from another CPU; if there
+//	are none at all, return NULL.
 // Side effect:
 //	Thread is removed from the ready list.
 //----------------------------------------------------------------------
@@ -87,13 +144,76 @@ Scheduler::ReadyToRun (Thread *thread, bool prepend)
 Thread *
 Scheduler::FindNextToRun ()
 {
-    return (Thread *)readyList->Remove();
+    Thread *thread = policy[cpu]->Remove();
+
+    if (thread != NULL)
+	numReady[cpu]--;
+    else if (numCPUs > 1)
+	thread = Steal(cpu);
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::YieldsTo, Dispatched, Stopped, TimerExpired, NeedsTimer,
+// PolicyName
+// 	Ask the scheduling policy of the current CPU.  See schedpolicy.h.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::YieldsTo (Thread *nextThread)
+{
+    return policy[cpu]->YieldsTo(nextThread, currentThread);
+}
+
+void
+Scheduler::Dispatched (Thread *thread)
+{
+    policy[cpu]->Dispatched(thread);
+    ArmTimer(thread);
+}
+
+void
+Scheduler::Stopped (Thread *thread)
+{
+    policy[cpu]->Stopped(thread);
+}
+
+bool
+Scheduler::TimerExpired ()
+{
+    return policy[cpu]->TimerExpired(currentThread);
+}
+
+bool
+Scheduler::NeedsTimer ()
+{
+    return policy[0]->NeedsTimer();
+}
+
+const char *
+Scheduler::PolicyName ()
+{
+    return policy[0]->Name();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ArmTimer
+// 	With a tickless timer, have it interrupt when the time slice of
+//	"thread", running on the current CPU, is up -- or not at all, if
+//	it is not time sliced.
+//----------------------------------------------------------------------
+
+void
+Scheduler::ArmTimer (Thread *thread)
+{
+    if (timer != NULL && timer->IsOneShot())
+	timer->Arm(policy[cpu]->SliceLeft(thread));
 }
 
 //----------------------------------------------------------------------
 // Scheduler::Run
-// 	Dispatch the CPU to nextThread.  Save the state of the old thread,
-//	and load the state of the new thread, by calling the machine
+// 	Dispatch the current CPU to nextThread.  Save the state of the old
+//	thread, and load the state of the new thread, by calling the machine
 //	dependent context switch routine, SWITCH.
 //
 //      Note: we assume the state of the previously running thread has
@@ -120,6 +240,9 @@ Scheduler::Run (Thread *nextThread)
 
     currentThread = nextThread;		    // switch to the next thread
     currentThread->setStatus(RUNNING);      // nextThread is now running
+    currentThread->setCPU(cpu);
+    localTime[cpu] = max(localTime[cpu], stats->totalTicks);
+    keptRunning = FALSE;
     
     DEBUG('t', "Switching from thread \"%s\" to thread \"%s\"\n",
 	  oldThread->getName(), nextThread->getName());
@@ -131,7 +254,21 @@ Scheduler::Run (Thread *nextThread)
 
     SWITCH(oldThread, nextThread);
     
-    DEBUG('t', "Now in thread \"%s\"\n", currentThread->getName());
+    Resumed();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Resumed
+// 	Finish a context switch, in the thread switched to: either when
+//	SWITCH returns (in Run or SwitchCPU), or when a new thread starts.
+//	Unless the thread simply goes on running on its CPU, it starts a
+//	new time slice.
+//----------------------------------------------------------------------
+void
+Scheduler::Resumed ()
+{
+    DEBUG('t', "Now in thread \"%s\" on CPU %d\n", currentThread->getName(),
+	  cpu);
 
     // If the old thread gave up the processor because it was finishing,
     // we need to delete its carcass.  Note we cannot delete the thread
@@ -142,9 +279,8 @@ Scheduler::Run (Thread *nextThread)
 	threadToBeDestroyed = NULL;
     }
 
-#ifdef SCHED_RR
-    currentThread->RecordTime(stats->totalTicks);
-#endif
+    if (!keptRunning)
+	Dispatched(currentThread);
     
 #ifdef USER_PROGRAM
     if (currentThread->space != NULL) {	// if there is an address space
@@ -154,15 +290,231 @@ Scheduler::Run (Thread *nextThread)
 #endif // USER_PROGRAM
 }
 
+//----------------------------------------------------------------------
+// Scheduler::Elapse
+// 	The current CPU has run for "ticks".  Simulated time is that of
+//	the busy CPU which is the furthest behind: an interrupt is only
+//	due once every busy CPU has reached it.
+//----------------------------------------------------------------------
+void
+Scheduler::Elapse (int ticks)
+{
+    int c, slowest = cpu;
+
+    localTime[cpu] += ticks;
+    stats->cpuBusyTicks[cpu] += ticks;
+    for (c = 0; c < numCPUs; c++)
+	if (running[c] != NULL && localTime[c] < localTime[slowest])
+	    slowest = c;
+    stats->totalTicks = max(stats->totalTicks, localTime[slowest]);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Interleave
+// 	Called on every tick with several CPUs, while interrupts are 
+//	disabled.  Let another CPU run if
+//	    - it is idle, and a thread is ready: it starts running it;
+//	    - or the current CPU is CPUSwitchTicks ahead of the slowest
+//	      busy CPU: that one catches up.
+//	Every BalanceInterval ticks, even out the ready queues first.
+//
+//	Return TRUE if, while the current CPU was not running, a thread
+//	became ready on it which preempts its thread.
+//----------------------------------------------------------------------
+bool
+Scheduler::Interleave ()
+{
+    int c, next = -1, ready = 0;
+    bool preempted;
+
+    if (stats->totalTicks - lastBalance >= BalanceInterval)
+	Balance();
+
+    for (c = 0; c < numCPUs; c++)
+	ready += numReady[c];
+    for (c = 0; ready > 0 && c < numCPUs; c++)
+	if (c != cpu && running[c] == NULL && 
+			(next == -1 || numReady[c] > numReady[next]))
+	    next = c;
+    if (next == -1 && localTime[cpu] - stats->totalTicks >= CPUSwitchTicks) {
+	for (c = 0; c < numCPUs; c++)
+	    if (c != cpu && running[c] != NULL &&
+			(next == -1 || localTime[c] < localTime[next]))
+		next = c;
+    }
+    if (next == -1)
+	return FALSE;
+
+    running[cpu] = currentThread;
+    SwitchCPU(next);
+
+    preempted = needResched[cpu];
+    needResched[cpu] = FALSE;
+    return preempted;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::RunOtherCPU
+// 	The current thread is blocked, and no thread is ready to run on
+//	any CPU.  Rather than wait for an interrupt, leave the current CPU 
+//	idle and let the busy CPU which is the furthest behind run.  
+//	Return TRUE once the current thread has been woken up and 
+//	dispatched again, or FALSE at once if every other CPU is idle.
+//----------------------------------------------------------------------
+bool
+Scheduler::RunOtherCPU ()
+{
+    int c, next = -1;
+
+    for (c = 0; c < numCPUs; c++)
+	if (c != cpu && running[c] != NULL &&
+			(next == -1 || localTime[c] < localTime[next]))
+	    next = c;
+    if (next == -1)
+	return FALSE;
+
+    running[cpu] = NULL;
+    SwitchCPU(next);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::SwitchCPU
+// 	Let CPU "next" run: either go on with its thread, or, if it is
+//	idle, dispatch the next thread ready for it.  The caller has set
+//	running[cpu] to the thread the current CPU goes on with (if any)
+//	once it runs again.  Returns when the current thread runs again.
+//
+//	The TLB is flushed on every switch (by AddrSpace::RestoreState),
+//	so no CPU ever sees stale translations of another.
+//----------------------------------------------------------------------
+void
+Scheduler::SwitchCPU (int next)
+{
+    Thread *oldThread = currentThread;
+    Thread *nextThread = running[next];
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+#ifdef USER_PROGRAM
+    if (oldThread->space != NULL) {
+        oldThread->SaveUserState();
+	oldThread->space->SaveState();
+    }
+#endif // USER_PROGRAM
+    oldThread->CheckOverflow();
+
+    DEBUG('t', "Switching from CPU %d to CPU %d\n", cpu, next);
+    cpu = next;
+    running[cpu] = NULL;
+    if (nextThread == NULL) {		// idle: give it a thread
+	nextThread = FindNextToRun();
+	ASSERT(nextThread != NULL);
+	nextThread->setStatus(RUNNING);
+	nextThread->setCPU(cpu);
+	localTime[cpu] = max(localTime[cpu], stats->totalTicks);
+	keptRunning = FALSE;
+    } else
+	keptRunning = TRUE;
+    currentThread = nextThread;
+
+    SWITCH(oldThread, nextThread);
+
+    Resumed();
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::LeastLoaded
+// 	Return the CPU with the fewest threads, ready or running; the 
+//	current CPU if there is a tie.
+//----------------------------------------------------------------------
+int
+Scheduler::LeastLoaded ()
+{
+    int c, load, best = cpu, bestLoad = numReady[cpu] + 1;
+
+    for (c = 0; c < numCPUs; c++) {
+	load = numReady[c] + ((running[c] != NULL) ? 1 : 0);
+	if (c != cpu && load < bestLoad) {
+	    best = c;
+	    bestLoad = load;
+	}
+    }
+    return best;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Steal
+// 	CPU "to" has nothing to run: take the next ready thread of the 
+//	CPU with the most ready threads.  Return NULL if there are none.
+//----------------------------------------------------------------------
+Thread *
+Scheduler::Steal (int to)
+{
+    int c, from = -1;
+    Thread *thread;
+
+    for (c = 0; c < numCPUs; c++)
+	if (c != to && numReady[c] > 0 && 
+			(from == -1 || numReady[c] > numReady[from]))
+	    from = c;
+    if (from == -1)
+	return NULL;
+
+    thread = policy[from]->Remove();
+    numReady[from]--;
+    stats->numMigrations++;
+    DEBUG('t', "CPU %d steals thread \"%s\" from CPU %d\n", to, 
+	  thread->getName(), from);
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Balance
+// 	Move ready threads from the longest ready queue to the shortest,
+//	until their lengths differ by one at most.  A thread moved goes on
+//	coming back to its new CPU.
+//----------------------------------------------------------------------
+void
+Scheduler::Balance ()
+{
+    int c, most, least;
+    Thread *thread;
+
+    lastBalance = stats->totalTicks;
+    for (;;) {
+	most = least = 0;
+	for (c = 1; c < numCPUs; c++) {
+	    if (numReady[c] > numReady[most])
+		most = c;
+	    if (numReady[c] < numReady[least])
+		least = c;
+	}
+	if (numReady[most] - numReady[least] <= 1)
+	    break;
+
+	thread = policy[most]->Remove();
+	numReady[most]--;
+	thread->setCPU(least);
+	policy[least]->Add(thread, FALSE);
+	numReady[least]++;
+	stats->numMigrations++;
+    }
+}
+
 //----------------------------------------------------------------------
 // Scheduler::Print
 // 	Print the scheduler state -- in other words, the contents of
-//	the ready list.  For debugging.
+//	the ready lists.  For debugging.
 //----------------------------------------------------------------------
 void
 Scheduler::Print()
 {
-    printf("Ready list contents: ");
-    readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
-    printf("\n");
+    for (int i = 0; i < numCPUs; i++) {
+	if (numCPUs > 1)
+	    printf("CPU %d: ", i);
+	printf("Ready list contents (%s): ", policy[i]->Name());
+	policy[i]->Print();
+	printf("\n");
+    }
 }
@@ -12,14 +12,32 @@
 #include "copyright.h"
 #include "list.h"
 #include "thread.h"
+#include "stats.h"
+
+class SchedPolicy;
 
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
 // thread is running, and which threads are ready but not running.
+// The order in which the ready threads run is up to the scheduling
+// policy (cf. schedpolicy.h).
+//
+// There may be several simulated CPUs, each with its own running 
+// thread (NULL if it is idle), ready queue and clock.  They run one
+// at a time, taking turns deterministically: the CPU which is running
+// goes on until its clock is CPUSwitchTicks ahead of the slowest busy
+// CPU, and stats->totalTicks is the clock of the slowest busy CPU.
+// The registers of the CPUs are those of their running threads, saved
+// in the threads while another CPU runs; "currentThread" is the thread
+// of the CPU running now.  Disabling interrupts keeps the CPU running,
+// hence acts as one lock over the whole kernel.
 
 class Scheduler {
   public:
-    Scheduler();			// Initialize list of ready threads 
+    Scheduler(SchedPolicy **schedPolicies, int nCPUs); 
+					// Initialize the lists of ready 
+					// threads of the "nCPUs" CPUs, kept
+					// by "schedPolicies"
     ~Scheduler();			// De-allocate ready list
 
     void ReadyToRun(Thread* thread, bool prepend=false);
@@ -29,10 +47,53 @@ class Scheduler {
 					// list, if any, and return thread.
     void Run(Thread* nextThread);	// Cause nextThread to start running
     void Print();			// Print contents of ready list
+    void Reprioritize(Thread* thread, int oldPri);
+					// The priority of a ready thread
+					// has changed from "oldPri"
+
+    bool YieldsTo(Thread* nextThread);	// Should the current thread, 
+					// yielding, let nextThread run?
+    void Dispatched(Thread* thread);	// Start a new time slice of thread
+    void Stopped(Thread* thread);	// The current thread stops running
+    bool TimerExpired();		// Has the current thread used up
+					// its time slice?
+    bool NeedsTimer();			// Does the policy slice time?
+    void ArmTimer(Thread* thread);	// With a tickless timer, interrupt
+					// when the slice of thread is up
+    const char *PolicyName();		// The policy in use
+
+    int NumCPUs() { return numCPUs; }
+    void Elapse(int ticks);		// The CPU running now has run for
+					// "ticks": update stats->totalTicks
+    bool Interleave();			// Maybe let another CPU run for a
+					// while; return TRUE if the current
+					// thread was preempted meanwhile
+    bool RunOtherCPU();			// The current thread is blocked and
+					// no thread is ready: leave its CPU
+					// idle, and let another one run.
+					// Return when it runs again, or
+					// FALSE at once if no CPU is busy
+    void Resumed();			// Called by the thread switched to,
+					// once it runs again
     
   private:
-    List *readyList;  		// queue of threads that are ready to run,
-				// but not running
+    void SwitchCPU(int next);		// Let CPU "next" run for a while
+    int LeastLoaded();			// the CPU with the least threads
+    Thread *Steal(int to);		// a ready thread of the busiest CPU
+    void Balance();			// even out the ready queues
+
+    int numCPUs;		// number of simulated CPUs
+    int cpu;			// the CPU running now
+    SchedPolicy *policy[MaxNumCPUs]; // per CPU, keeps the threads that 
+				// are ready to run, but not running
+    int numReady[MaxNumCPUs];	// # of threads in each policy
+    Thread *running[MaxNumCPUs]; // thread of each CPU, NULL if idle
+    int localTime[MaxNumCPUs];	// clock of each CPU
+    bool needResched[MaxNumCPUs]; // should the thread of the CPU yield,
+				// once the CPU runs again?
+    int lastBalance;		// stats->totalTicks at the last Balance
+    bool keptRunning;		// was the thread switched to already
+				// running on its CPU (cf. Resumed)?
 };
 
 #endif // SCHEDULER_H
@@ -37,7 +37,9 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 {
     name = debugName;
     value = initialValue;
-    queue = new List;
+#ifdef SYNCH_PROF
+    prof = SynchProf::Find("Semaphore", debugName);
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -48,7 +50,6 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 
 Semaphore::~Semaphore()
 {
-    delete queue;
 }
 
 //----------------------------------------------------------------------
@@ -65,13 +66,21 @@ void
 Semaphore::P()
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+#ifdef SYNCH_PROF
+    int since = stats->totalTicks;
+    bool contended = (value == 0);
+#endif
     
     while (value == 0) { 			// semaphore not available
-	queue->Append((void *)currentThread);	// so go to sleep
+	queue.Append(currentThread);	// so go to sleep
 	currentThread->Sleep();
     } 
     value--; 					// semaphore available, 
 						// consume its value
+#ifdef SYNCH_PROF
+    if (prof != NULL)
+	prof->Acquired(since, contended);
+#endif
     
     (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
 }
@@ -90,7 +99,7 @@ Semaphore::V()
     Thread *thread;
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
-    thread = (Thread *)queue->Remove();
+    thread = queue.Remove();
     if (thread != NULL)	   // make thread ready, consuming the V immediately
 	scheduler->ReadyToRun(thread);
     value++;
@@ -98,41 +107,166 @@ Semaphore::V()
 }
 
 
-Lock::Lock(char* debugName)  
+int Lock::spinBudget = DefaultSpinTicks;
+
+Lock::Lock(char* debugName, bool isAdaptive)  
 {
     name = debugName;
+    adaptive = isAdaptive;
     sem = new Semaphore("mutex", 1);
     owner = NULL;
+    for (int i = 0; i < NumPriLevels; i++)
+	numWaiting[i] = 0;
+    nextHeld = NULL;
+#ifdef SYNCH_PROF
+    prof = SynchProf::Find("Lock", debugName);
+    sem->prof = NULL;		// counted here, as the lock
+#endif
 }
 
 Lock::~Lock() {
     delete sem;
 }
 
+//----------------------------------------------------------------------
+// Lock::Acquire
+// 	Wait until the lock is free, then take it.  While waiting, the
+//	current thread lends its priority to the holder (cf. Donate).
+//	Once it has the lock, it inherits the priority of the threads
+//	still waiting -- which may have been passed over, if it took
+//	the lock as it was released.
+//----------------------------------------------------------------------
+
 void Lock::Acquire() 
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+#ifdef SYNCH_PROF
+    int since = stats->totalTicks;
+    bool contended = (owner != NULL);
+#endif
     
     ASSERT(owner != currentThread); // make sure that
                                 // nested locking does not happen
-    sem->P();
+    if (adaptive && owner != NULL && oldLevel == IntOn)
+	Spin();
+    if (owner != NULL) {
+	currentThread->waitingFor = this;
+	numWaiting[currentThread->getPriority()]++;
+	Donate(currentThread->getPriority());
+	sem->P();
+	numWaiting[currentThread->getPriority()]--;
+	currentThread->waitingFor = NULL;
+    } else
+	sem->P();
     owner = currentThread;
+    nextHeld = owner->heldLocks;
+    owner->heldLocks = this;
+    owner->setPriority(min(owner->getPriority(), TopWaiter()));
+#ifdef SYNCH_PROF
+    prof->Acquired(since, contended);
+    heldSince = stats->totalTicks;
+#endif
     
     (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
 }
 
+//----------------------------------------------------------------------
+// Lock::Spin
+// 	The lock is busy.  While its holder is running on another CPU
+//	(the current thread being the only one running on this CPU), 
+//	let time pass a tick at a time: enabling interrupts lets the 
+//	other CPUs catch up, and the holder may release the lock.  Give
+//	up once the holder stops running or spinBudget ticks have passed.
+//
+//	Called with interrupts disabled, and returns with them disabled;
+//	the caller only spins if it was called with interrupts enabled.
+//----------------------------------------------------------------------
+
+void Lock::Spin()
+{
+    int spun = 0;
+
+    while (owner != NULL && owner->getStatus() == RUNNING &&
+						spun < spinBudget) {
+	(void) interrupt->SetLevel(IntOn);	// one tick passes
+	(void) interrupt->SetLevel(IntOff);
+	spun += SystemTick;
+    }
+    if (spun == 0)
+	return;
+    stats->numLockSpins++;
+    stats->lockSpinTicks += spun;
+    if (owner == NULL)
+	stats->numSpinAcquires++;
+}
+
+//----------------------------------------------------------------------
+// Lock::Release
+// 	Give up the lock, and the priority inherited through it, before
+//	waking up a waiter -- which can then preempt the current thread.
+//----------------------------------------------------------------------
+
 void Lock::Release() 
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff); // disable interrupts
+    Lock **ptr;
 
     ASSERT(isHeldByCurrentThread()); // only the thread who acquired 
                                     // this lock can release it
-    sem->V();
+#ifdef SYNCH_PROF
+    prof->Released(heldSince);
+#endif
+    for (ptr = &owner->heldLocks; *ptr != this; ptr = &(*ptr)->nextHeld)
+	;
+    *ptr = nextHeld;
     owner = NULL;
+    currentThread->setPriority(currentThread->InheritedPriority());
+    sem->V();
 
     (void) interrupt->SetLevel(oldLevel); // re-enable interrupts
 }
 
+//----------------------------------------------------------------------
+// Lock::Donate
+// 	A thread of priority "p" is waiting for this lock: raise the
+//	holder to "p", and if the holder is waiting for another lock, 
+//	the holder of that one, and so on.  The walk stops at a holder
+//	already running at "p" or higher, so a deadlock cycle ends it.
+//----------------------------------------------------------------------
+
+void Lock::Donate(int p)
+{
+    Lock *lock;
+
+    for (lock = this; lock != NULL && lock->owner != NULL; 
+				lock = lock->owner->waitingFor) {
+	if (lock->owner->getPriority() <= p)
+	    break;
+	lock->owner->setPriority(p);
+    }
+}
+
+//----------------------------------------------------------------------
+// Lock::Requeue, TopWaiter
+// 	Count a waiter at its new priority; return the highest priority 
+//	of a waiter.
+//----------------------------------------------------------------------
+
+void Lock::Requeue(int oldPri, int newPri)
+{
+    numWaiting[oldPri]--;
+    numWaiting[newPri]++;
+}
+
+int Lock::TopWaiter()
+{
+    int p;
+
+    for (p = 0; p < NumPriLevels && numWaiting[p] == 0; p++)
+	;
+    return p;
+}
+
 bool Lock::isHeldByCurrentThread()
 {
     return owner == currentThread;
@@ -141,12 +275,13 @@ bool Lock::isHeldByCurrentThread()
 Condition::Condition(char* debugName) 
 {
     name = debugName;
-    queue = new List;
+#ifdef SYNCH_PROF
+    prof = SynchProf::Find("Condition", debugName);
+#endif
 }
 
 Condition::~Condition() 
 {
-    delete queue;
 }
 
 //----------------------------------------------------------------------
@@ -157,11 +292,17 @@ Condition::~Condition()
 void Condition::Wait(Lock* conditionLock) 
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+#ifdef SYNCH_PROF
+    int since = stats->totalTicks;
+#endif
     
     conditionLock->Release();
-	queue->Append((void *)currentThread);
+	queue.Append(currentThread);
 	currentThread->Sleep();
     conditionLock->Acquire();
+#ifdef SYNCH_PROF
+    prof->Acquired(since, TRUE);
+#endif
     
     (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
 }
@@ -175,7 +316,7 @@ void Condition::Signal(Lock* conditionLock)
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff); // disable interrupts
 
-    Thread *thread = (Thread *)queue->Remove();
+    Thread *thread = queue.Remove();
     if (thread != NULL)	   // make thread ready
 	    scheduler->ReadyToRun(thread);
 
@@ -192,8 +333,275 @@ void Condition::Broadcast(Lock* conditionLock)
     IntStatus oldLevel = interrupt->SetLevel(IntOff); // disable interrupts
 
     Thread* thread;
-    while ((thread = (Thread *)queue->Remove()) != NULL)	   // make thread ready
+    while ((thread = queue.Remove()) != NULL)	   // make thread ready
 	    scheduler->ReadyToRun(thread);
 
     (void) interrupt->SetLevel(oldLevel); // re-enable interrupts
 }
+
+//----------------------------------------------------------------------
+// RWLock::RWLock, ~RWLock
+// 	Initialize a reader-writer lock, free, where readers and writers
+//	go in the order set by "rwPolicy"; de-allocate it, when no one
+//	holds it or waits for it.
+//----------------------------------------------------------------------
+RWLock::RWLock(char* debugName, RWPolicy rwPolicy)
+{
+    name = debugName;
+    policy = rwPolicy;
+    lock = new Lock(debugName);
+    readersOk = new Condition(debugName);
+    writersOk = new Condition(debugName);
+    upgradeOk = new Condition(debugName);
+    numReaders = waitingReaders = waitingWriters = admitted = 0;
+    writer = NULL;
+    upgrading = FALSE;
+}
+
+RWLock::~RWLock()
+{
+    ASSERT(numReaders == 0 && writer == NULL);
+    delete lock;
+    delete readersOk;
+    delete writersOk;
+    delete upgradeOk;
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReaderMayEnter
+// 	A new reader gets in unless there is a writer, or a reader 
+//	upgrading, or -- preferring writers -- a writer waiting.  With
+//	RWFair, the readers admitted when the last writer left get in 
+//	anyway.
+//----------------------------------------------------------------------
+bool RWLock::ReaderMayEnter()
+{
+    if (writer != NULL || upgrading)
+	return FALSE;
+    if (policy == RWPreferReaders || waitingWriters == 0)
+	return TRUE;
+    return policy == RWFair && admitted > 0;
+}
+
+//----------------------------------------------------------------------
+// RWLock::WakeUp
+// 	The lock has just become free, or shared: wake up the reader
+//	upgrading if the other readers are gone, or else the waiting
+//	readers, or a waiting writer, as the policy says.  The threads
+//	woken check for themselves whether they may go in.
+//----------------------------------------------------------------------
+void RWLock::WakeUp()
+{
+    if (writer != NULL)
+	return;
+    if (upgrading) {
+	if (numReaders == 0)
+	    upgradeOk->Signal(lock);
+	return;
+    }
+    if (numReaders == 0 && waitingWriters > 0 && 
+			(policy != RWPreferReaders || waitingReaders == 0) &&
+			admitted == 0)
+	writersOk->Signal(lock);
+    else if (waitingReaders > 0 && ReaderMayEnter())
+	readersOk->Broadcast(lock);
+}
+
+void RWLock::AcquireRead()
+{
+    lock->Acquire();
+    waitingReaders++;
+    while (!ReaderMayEnter())
+	readersOk->Wait(lock);
+    waitingReaders--;
+    if (admitted > 0)
+	admitted--;
+    numReaders++;
+    lock->Release();
+}
+
+void RWLock::ReleaseRead()
+{
+    lock->Acquire();
+    ASSERT(numReaders > 0);
+    numReaders--;
+    WakeUp();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireWrite
+// 	Wait until no one holds the lock, no reader is upgrading, and
+//	the readers admitted ahead (RWFair), or all the waiting readers
+//	(RWPreferReaders), have got in.
+//----------------------------------------------------------------------
+void RWLock::AcquireWrite()
+{
+    lock->Acquire();
+    ASSERT(writer != currentThread);
+    waitingWriters++;
+    while (writer != NULL || numReaders > 0 || upgrading || admitted > 0 ||
+		(policy == RWPreferReaders && waitingReaders > 0))
+	writersOk->Wait(lock);
+    waitingWriters--;
+    writer = currentThread;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseWrite
+// 	Free the lock.  With RWFair, the readers waiting now are let in
+//	before the next writer.
+//----------------------------------------------------------------------
+void RWLock::ReleaseWrite()
+{
+    lock->Acquire();
+    ASSERT(isWriteHeldByCurrentThread());
+    writer = NULL;
+    if (policy == RWFair)
+	admitted = waitingReaders;
+    WakeUp();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::Upgrade
+// 	Turn the read lock of the current thread into the write lock,
+//	once the other readers have left.  Return FALSE, leaving it a 
+//	reader, if another reader is already waiting to upgrade.
+//----------------------------------------------------------------------
+bool RWLock::Upgrade()
+{
+    lock->Acquire();
+    ASSERT(numReaders > 0);
+    if (upgrading) {
+	lock->Release();
+	return FALSE;
+    }
+    upgrading = TRUE;
+    numReaders--;
+    while (numReaders > 0)
+	upgradeOk->Wait(lock);
+    upgrading = FALSE;
+    writer = currentThread;
+    lock->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// RWLock::Downgrade
+// 	Turn the write lock of the current thread into a read lock, and
+//	let in the readers which may now enter.
+//----------------------------------------------------------------------
+void RWLock::Downgrade()
+{
+    lock->Acquire();
+    ASSERT(isWriteHeldByCurrentThread());
+    writer = NULL;
+    numReaders++;
+    if (policy == RWFair)
+	admitted = waitingReaders;
+    WakeUp();
+    lock->Release();
+}
+
+bool RWLock::isWriteHeldByCurrentThread()
+{
+    return writer == currentThread;
+}
+
+#ifdef SYNCH_PROF
+static SynchProf synchProfs[MaxSynchProfs];	// zeroed before any
+static int numSynchProfs;			// static object uses them
+static SynchProf otherProf;			// counts what does not fit
+
+//----------------------------------------------------------------------
+// SynchProf::Find
+// 	Return the profile of the objects of "kind" called "name", 
+//	starting a new one for a new name.  Names are compared as 
+//	strings, since each object often has its own copy.
+//----------------------------------------------------------------------
+SynchProf *
+SynchProf::Find(const char *kind, char *name)
+{
+    SynchProf *prof;
+    int i;
+
+    if (name == NULL)
+	name = "(unnamed)";
+    for (i = 0; i < numSynchProfs; i++) {
+	prof = &synchProfs[i];
+	if (!strcmp(prof->kind, kind) && !strcmp(prof->name, name))
+	    return prof;
+    }
+    if (numSynchProfs == MaxSynchProfs) {
+	otherProf.kind = "-";
+	otherProf.name = "(others)";
+	return &otherProf;
+    }
+    prof = &synchProfs[numSynchProfs++];
+    prof->kind = kind;
+    prof->name = name;
+    return prof;
+}
+
+//----------------------------------------------------------------------
+// SynchProf::Acquired, Released
+// 	Count an acquisition, and the ticks spent waiting for it if it 
+//	was contended; count the ticks a lock was held.
+//----------------------------------------------------------------------
+void
+SynchProf::Acquired(int since, bool wasContended)
+{
+    int wait = stats->totalTicks - since;
+
+    acquisitions++;
+    if (wasContended) {
+	contended++;
+	waitTicks += wait;
+	maxWaitTicks = max(maxWaitTicks, wait);
+    }
+}
+
+void
+SynchProf::Released(int since)
+{
+    holdTicks += stats->totalTicks - since;
+}
+
+//----------------------------------------------------------------------
+// SynchProf::PrintAll
+// 	Print the profiles of the objects acquired at least once, the
+//	longest total wait first.
+//----------------------------------------------------------------------
+void
+SynchProf::PrintAll()
+{
+    SynchProf *sorted[MaxSynchProfs + 1], *prof;
+    int i, j, n = 0;
+
+    for (i = 0; i <= numSynchProfs; i++) {
+	prof = (i < numSynchProfs) ? &synchProfs[i] : &otherProf;
+	if (prof->acquisitions == 0)
+	    continue;
+	for (j = n++; j > 0 && sorted[j - 1]->waitTicks < prof->waitTicks; j--)
+	    sorted[j] = sorted[j - 1];
+	sorted[j] = prof;
+    }
+    if (n == 0)
+	return;
+    printf("Synchronization, by wait ticks:\n");
+    printf("%-10s %-16s %9s %9s %9s %9s %9s\n", "kind", "name", 
+	"acquired", "contended", "wait", "max wait", "held");
+    for (i = 0; i < n; i++) {
+	prof = sorted[i];
+	printf("%-10s %-16s %9d %9d %9d %9d ", prof->kind, prof->name, 
+	    prof->acquisitions, prof->contended, prof->waitTicks, 
+	    prof->maxWaitTicks);
+	if (!strcmp(prof->kind, "Lock"))
+	    printf("%9d\n", prof->holdTicks);
+	else
+	    printf("%9s\n", "-");
+    }
+}
+#endif // SYNCH_PROF
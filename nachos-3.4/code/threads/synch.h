@@ -5,7 +5,8 @@
 //	locks, and condition variables.  The implementation for
 //	semaphores is given; for the latter two, only the procedure
 //	interface is given -- they are to be implemented as part of 
-//	the first assignment.
+//	the first assignment.  Reader-writer locks are built on locks
+//	and condition variables.
 //
 //	Note that all the synchronization objects take a "name" as
 //	part of the initialization.  This is solely for debugging purposes.
@@ -21,6 +22,43 @@
 #include "thread.h"
 #include "list.h"
 
+#ifdef SYNCH_PROF
+// The following class keeps the contention profile of the semaphores,
+// locks and condition variables sharing a kind and a name (compile 
+// with -DSYNCH_PROF; without it, nothing is counted and the objects 
+// are no bigger).  Objects are grouped by name, so the "rw_lock" of
+// every open file, say, add up to a single line.
+//
+//	acquisitions -- P, Acquire or Wait calls
+//	contended -- those which had to sleep
+//	wait ticks -- total and longest time asleep in them
+//	hold ticks -- total time a lock was held
+//
+// The report, sorted by total wait, is printed when Nachos halts.
+
+#define MaxSynchProfs	64	// # of names profiled; later ones are
+				// all counted under "(others)"
+
+class SynchProf {
+  public:
+    static SynchProf *Find(const char *kind, char *name);
+					// the profile of "name", of "kind"
+    static void PrintAll();		// print the report
+    
+    void Acquired(int since, bool wasContended);
+					// one more acquisition, asleep from
+					// tick "since" if "contended"
+    void Released(int since);		// a lock held from "since" is free
+
+  private:
+    const char *kind;			// "Semaphore", "Lock", "Condition"
+    char *name;				// debug name of the objects
+    int acquisitions, contended;
+    int waitTicks, maxWaitTicks;
+    int holdTicks;
+};
+#endif // SYNCH_PROF
+
 // The following class defines a "semaphore" whose value is a non-negative
 // integer.  The semaphore has only two operations P() and V():
 //
@@ -48,7 +86,12 @@ class Semaphore {
   private:
     char* name;        // useful for debugging
     int value;         // semaphore value, always >= 0
-    List *queue;       // threads waiting in P() for the value to be > 0
+    IntrusiveList<Thread> queue; // threads waiting in P() for the value
+				// to be > 0
+#ifdef SYNCH_PROF
+    friend class Lock;
+    SynchProf *prof;		// contention profile, or NULL
+#endif
 };
 
 // The following class defines a "lock".  A lock can be BUSY or FREE.
@@ -62,10 +105,27 @@ class Semaphore {
 // In addition, by convention, only the thread that acquired the lock
 // may release it.  As with semaphores, you can't read the lock value
 // (because the value might change immediately after you read it).  
+//
+// To keep a low priority thread holding a lock from delaying a higher
+// priority thread waiting for it (priority inversion), the holder
+// inherits the priority of the highest waiter until it releases the
+// lock.  If the holder is itself waiting for another lock, the holder
+// of that one inherits it too, and so on down the chain.
+//
+// An "adaptive" lock, for short critical sections, does not put a
+// thread to sleep at once when it is busy: if the holder is running
+// on another CPU, the thread spins for up to the spin budget (cf. "-ls"
+// in main.cc), letting time pass with interrupts enabled, since the
+// holder will likely release the lock sooner than two context switches
+// would take.  It only sleeps if the holder is not running (or stops),
+// or the budget is used up.  Stats count how often spinning paid off.
+
+#define DefaultSpinTicks (5 * SystemTick) // spin budget, unless set
 
 class Lock {
   public:
-    Lock(char* debugName);  		// initialize lock to be FREE
+    Lock(char* debugName, bool isAdaptive = FALSE);
+					// initialize lock to be FREE
     ~Lock();				// deallocate lock
     char* getName() { return name; }	// debugging assist
 
@@ -77,11 +137,33 @@ class Lock {
 					// checking in Release, and in
 					// Condition variable ops below.
 
+    static void SetSpinBudget(int ticks) { spinBudget = ticks; }
+					// how long adaptive locks spin
+
   private:
+    friend class Thread;
+
+    void Spin();			// adaptive: wait a little for the
+					// holder to release the lock
+
+    void Donate(int p);			// a thread of priority "p" waits:
+					// raise the chain of holders to it
+    void Requeue(int oldPri, int newPri); // a waiter changed priority
+    int TopWaiter();			// highest priority of a waiter, or
+					// NumPriLevels if there is none
+
     char* name;				// for debugging
     Semaphore* sem;  
       // to be initialized as a binary semaphore for mutual exclusion
     Thread* owner; // owner thread of this lock, for debug use
+    int numWaiting[NumPriLevels]; // # of threads waiting, per priority
+    Lock *nextHeld; // next lock held by the owner (cf. Thread::heldLocks)
+    bool adaptive; // spin before sleeping?
+    static int spinBudget; // ticks an adaptive lock spins at most
+#ifdef SYNCH_PROF
+    SynchProf *prof; // contention profile
+    int heldSince; // stats->totalTicks when it was acquired
+#endif
 };
 
 // The following class defines a "condition variable".  A condition
@@ -133,6 +215,70 @@ class Condition {
 
   private:
     char* name;
-    List *queue; // threads waiting on this condition
+    IntrusiveList<Thread> queue; // threads waiting on this condition
+#ifdef SYNCH_PROF
+    SynchProf *prof; // contention profile
+#endif
 };
+
+// The following class defines a "reader-writer lock": any number of
+// readers may hold it at once, or a single writer.
+//
+//	AcquireRead/ReleaseRead -- take/give up the lock as a reader
+//
+//	AcquireWrite/ReleaseWrite -- take/give up the lock as a writer
+//
+//	Upgrade -- a reader becomes the writer, once the other readers
+//		are gone; it fails (returning FALSE, still a reader) if
+//		another reader is already upgrading, since both would 
+//		wait for each other
+//
+//	Downgrade -- the writer becomes a reader, letting in the other
+//		readers but no writer
+//
+// Who goes first, when both readers and writers wait, is set when the
+// lock is created:
+//	RWPreferWriters -- a new reader waits while a writer waits, so 
+//		readers cannot starve writers (the default)
+//	RWPreferReaders -- a writer waits until there are no readers
+//	RWFair -- like RWPreferWriters, but when a writer is done, the
+//		readers waiting at that time all get in before the next
+//		writer: neither side can starve the other
+// A reader upgrading goes before any waiting writer.
+
+enum RWPolicy { RWPreferWriters, RWPreferReaders, RWFair };
+
+class RWLock {
+  public:
+    RWLock(char* debugName, RWPolicy rwPolicy = RWPreferWriters);
+    ~RWLock();
+    char* getName() { return name; }
+
+    void AcquireRead();
+    void ReleaseRead();
+    void AcquireWrite();
+    void ReleaseWrite();
+    bool Upgrade();			// reader to writer, if possible
+    void Downgrade();			// writer to reader
+
+    bool isWriteHeldByCurrentThread();	// is the current thread the writer?
+
+  private:
+    bool ReaderMayEnter();		// can a new reader get in now?
+    void WakeUp();			// let in whoever goes next
+
+    char* name;
+    RWPolicy policy;
+    Lock *lock;				// protects the fields below
+    Condition *readersOk;		// readers wait here
+    Condition *writersOk;		// writers wait here
+    Condition *upgradeOk;		// the reader upgrading waits here
+    int numReaders;			// # of readers holding the lock
+    Thread *writer;			// the writer holding it, or NULL
+    int waitingReaders, waitingWriters;	// # waiting to get in
+    int admitted;			// RWFair: # of waiting readers let
+					// in ahead of the waiting writers
+    bool upgrading;			// is a reader waiting to upgrade?
+};
+
 #endif // SYNCH_H
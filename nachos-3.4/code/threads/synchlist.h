@@ -2,7 +2,8 @@
 //	Data structures for synchronized access to a list.
 //
 //	Implemented by surrounding the List abstraction
-//	with synchronization routines.
+//	with synchronization routines.  IntrusiveSynchList does the same
+//	for an IntrusiveList, without allocating memory per item.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -39,4 +40,74 @@ class SynchList {
     Condition *listEmpty;	// wait in Remove if the list is empty
 };
 
+// The same, for items of type T with their own links (cf. IntrusiveList
+// in list.h).
+
+template <class T>
+class IntrusiveSynchList {
+  public:
+    IntrusiveSynchList();	// initialize a synchronized list
+    ~IntrusiveSynchList();	// de-allocate a synchronized list
+
+    void Append(T *item);	// append item to the end of the list,
+				// and wake up any thread waiting in remove
+    T *Remove();		// remove the first item from the front of
+				// the list, waiting if the list is empty
+				// apply function to every item in the list
+    void Mapcar(VoidFunctionPtr func);
+
+  private:
+    IntrusiveList<T> list;	// the unsynchronized list
+    Lock *lock;			// enforce mutual exclusive access to the list
+    Condition *listEmpty;	// wait in Remove if the list is empty
+};
+
+template <class T>
+IntrusiveSynchList<T>::IntrusiveSynchList()
+{
+    lock = new Lock("list lock"); 
+    listEmpty = new Condition("list empty cond");
+}
+
+template <class T>
+IntrusiveSynchList<T>::~IntrusiveSynchList()
+{ 
+    delete lock;
+    delete listEmpty;
+}
+
+template <class T>
+void
+IntrusiveSynchList<T>::Append(T *item)
+{
+    lock->Acquire();		// enforce mutual exclusive access to the list 
+    list.Append(item);
+    listEmpty->Signal(lock);	// wake up a waiter, if any
+    lock->Release();
+}
+
+template <class T>
+T *
+IntrusiveSynchList<T>::Remove()
+{
+    T *item;
+
+    lock->Acquire();			// enforce mutual exclusion
+    while (list.IsEmpty())
+	listEmpty->Wait(lock);		// wait until list isn't empty
+    item = list.Remove();
+    ASSERT(item != NULL);
+    lock->Release();
+    return item;
+}
+
+template <class T>
+void
+IntrusiveSynchList<T>::Mapcar(VoidFunctionPtr func)
+{ 
+    lock->Acquire(); 
+    list.Mapcar(func);
+    lock->Release(); 
+}
+
 #endif // SYNCHLIST_H
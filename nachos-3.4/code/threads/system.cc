@@ -7,6 +7,11 @@
 
 #include "copyright.h"
 #include "system.h"
+#include "schedpolicy.h"
+#include "synch.h"
+#ifdef INV_PG
+#include "pagerepl.h"
+#endif
 
 // This defines *all* of the global data structures used by Nachos.
 // These are all initialized and de-allocated by this file.
@@ -29,6 +34,7 @@ SynchDisk   *synchDisk;
 
 #ifdef USER_PROGRAM	// requires either FILESYS or FILESYS_STUB
 Machine *machine;	// user program memory and registers
+int hostJob = 0;	// UNIX process started by "-j", or 0
 #endif
 
 #ifdef NETWORK
@@ -45,7 +51,10 @@ extern void Cleanup();
 // 	Interrupt handler for the timer device.  The timer device is
 //	set up to interrupt the CPU periodically (once every TimerTicks).
 //	This routine is called each time there is a timer interrupt,
-//	with interrupts disabled.
+//	with interrupts disabled.  The scheduling policy decides if the
+//	current thread has used up its time slice.  A tickless timer only
+//	interrupts when a time slice is due to end; if the thread goes on
+//	anyway, it is armed again.
 //
 //	Note that instead of calling Yield() directly (which would
 //	suspend the interrupt handler, not the interrupted thread
@@ -60,15 +69,12 @@ extern void Cleanup();
 static void
 TimerInterruptHandler(int dummy)
 {
-#ifdef SCHED_RR
-	if (interrupt->getStatus() != IdleMode){
-        if (currentThread->isTimeExpired(stats->totalTicks))
-            interrupt->YieldOnReturn();
-    }
-#else // SCHED_NAIVE, SCHED_PRI_PRMPT
-    if (interrupt->getStatus() != IdleMode)
+    if (interrupt->getStatus() == IdleMode)
+	    return;
+    if (scheduler->TimerExpired())
 	    interrupt->YieldOnReturn();
-#endif
+    else
+	    scheduler->ArmTimer(currentThread);
 }
 
 //----------------------------------------------------------------------
@@ -87,9 +93,17 @@ Initialize(int argc, char **argv)
     int argCount;
     char* debugArgs = "";
     bool randomYield = FALSE;
+    bool tickless = FALSE;	// only interrupt when a time slice ends
+    char *schedPolicy = "fifo";	// scheduling policy
+    int numCPUs = 1;		// number of simulated CPUs
+    SchedPolicy *policies[MaxNumCPUs];
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE;	// single step user program
+    bool threadedDispatch = FALSE;	// use the fast execution engine
+#ifdef INV_PG
+    char *replPolicy = "lru";	// page replacement policy
+#endif
 #endif
 #ifdef FILESYS_NEEDED
     bool format = FALSE;	// format disk
@@ -114,10 +128,38 @@ Initialize(int argc, char **argv)
                             // number generator
             randomYield = TRUE;
             argCount = 2;
+        } else if (!strcmp(*argv, "-tl")) {
+            tickless = TRUE;
+        } else if (!strcmp(*argv, "-sp")) {
+            ASSERT(argc > 1);
+            schedPolicy = *(argv + 1);
+            argCount = 2;
+        } else if (!strcmp(*argv, "-ut")) {
+            ASSERT(argc > 2);
+            SetUserTickets(*(argv + 1), atoi(*(argv + 2)));
+            argCount = 3;
+        } else if (!strcmp(*argv, "-ls")) {
+            ASSERT(argc > 1);
+            Lock::SetSpinBudget(atoi(*(argv + 1)));
+            argCount = 2;
+        } else if (!strcmp(*argv, "-cpus")) {
+            ASSERT(argc > 1);
+            numCPUs = atoi(*(argv + 1));
+            ASSERT(numCPUs >= 1 && numCPUs <= MaxNumCPUs);
+            argCount = 2;
         }
 #ifdef USER_PROGRAM
         if (!strcmp(*argv, "-s"))
             debugUserProg = TRUE;
+        if (!strcmp(*argv, "-td"))
+            threadedDispatch = TRUE;
+#ifdef INV_PG
+        if (!strcmp(*argv, "-pr")) {
+            ASSERT(argc > 1);
+            replPolicy = *(argv + 1);
+            argCount = 2;
+        }
+#endif
 #endif
 #ifdef FILESYS_NEEDED
         if (!strcmp(*argv, "-f"))
@@ -139,28 +181,44 @@ Initialize(int argc, char **argv)
     DebugInit(debugArgs);			// initialize DEBUG messages
     stats = new Statistics();			// collect statistics
     interrupt = new Interrupt;			// start up interrupt handling
-    scheduler = new Scheduler();		// initialize the ready queue
+    for (int i = 0; i < numCPUs; i++) {		// one policy per CPU
+        policies[i] = NewSchedPolicy(schedPolicy);
+        if (policies[i] == NULL) {
+            printf("Unknown scheduling policy \"%s\"\n", schedPolicy);
+            Exit(1);
+        }
+    }
+    scheduler = new Scheduler(policies, numCPUs); // initialize the ready queues
+    stats->numCPUs = numCPUs;
 
-#ifdef SCHED_RR
-	timer = new Timer(TimerInterruptHandler, 0, randomYield);
-#else // SCHED_NAIVE, SCHED_PRI_PRMPT
-    if (randomYield)				// start the timer (if needed)
-	    timer = new Timer(TimerInterruptHandler, 0, randomYield);
-#endif
+    if (randomYield || scheduler->NeedsTimer())	// start the timer (if needed)
+	    timer = new Timer(TimerInterruptHandler, 0, randomYield,
+			tickless && !randomYield && numCPUs == 1);
 
     threadToBeDestroyed = NULL;
+    Thread::PrewarmStacks(StackPoolPrewarm);
 
     // We didn't explicitly allocate the current thread we are running in.
     // But if it ever tries to give up the CPU, we better have a Thread
     // object to save its state. 
     currentThread = new Thread("main");		
     currentThread->setStatus(RUNNING);
+    scheduler->ArmTimer(currentThread);	// a tickless timer starts with
+					// the slice of the main thread
 
     interrupt->Enable();
     CallOnUserAbort(Cleanup);			// if user hits ctl-C
     
 #ifdef USER_PROGRAM
-    machine = new Machine(debugUserProg);	// this must come first
+    machine = new Machine(debugUserProg, threadedDispatch);	// this must come first
+#ifdef INV_PG
+    machine->replacer = NewPageReplacer(replPolicy);
+    if (machine->replacer == NULL) {
+        printf("Unknown page replacement policy \"%s\"\n", replPolicy);
+        Exit(1);
+    }
+    stats->replPolicy = machine->replacer->Name();
+#endif
 #endif
 
 #ifdef FILESYS
@@ -32,6 +32,8 @@ extern Timer *timer;				// the hardware alarm clock
 #ifdef USER_PROGRAM
 #include "machine.h"
 extern Machine* machine;	// user program memory and registers
+extern int hostJob;		// which of the UNIX processes started by
+				// "-j" this is (1, 2, ...), or 0
 #endif
 
 #ifdef FILESYS_NEEDED 		// FILESYS or FILESYS_STUB 
@@ -27,11 +27,10 @@
 const char* status_str[4] = {"JUST_CREATED", "RUNNING", 
                             "READY", "BLOCKED"};
 
-int Thread::totalNum = 0;
-int Thread::tidLast = -1;
-bool Thread::tidAssigned[MaxNumThreads] = {0};
-Thread* Thread::tid2ptr[MaxNumThreads] = {NULL};
-int Thread::tid2exitcode[MaxNumThreads] = {0};
+ThreadTable Thread::table;
+int *Thread::stackPool[StackPoolSize];
+int Thread::numPooled = 0;
+int Thread::rtLoad = 0;
 
 //----------------------------------------------------------------------
 // Thread::Thread
@@ -43,41 +42,22 @@ int Thread::tid2exitcode[MaxNumThreads] = {0};
 //  default priority: the lowest priority, i.e. NumPriLevels-1
 //----------------------------------------------------------------------
 
-#ifdef SCHED_PRI_PRMPT
 Thread::Thread(char* threadName, int priority, char* userid)
-#else // SCHED_NAIVE, SCHED_RR
-Thread::Thread(char* threadName, char* userid)
-#endif
 {
     name = threadName;
     uID = userid;
 
-#ifdef SCHED_PRI_PRMPT
-    ASSERT(pri >= 0 && pri < NumPriLevels);
-    pri = priority;
-#endif
-#ifdef SCHED_RR
+    ASSERT(priority >= 0 && priority < NumPriLevels);
+    pri = basePri = priority;
+    heldLocks = waitingFor = NULL;
+    level = 0;
+    cpu = -1;
+    tickets = DefaultTickets;
+    pass = 0;
+    period = budget = deadline = 0;
     runningSince = 0;
-#endif
-    
-    if(totalNum >= MaxNumThreads){
-        fprintf(stderr, "ERROR: Number of threads exceeded!\n");                                          \
-	    fflush(stderr);
-        Abort(); 
-    }
-    totalNum++;
 
-    // assign a new tID
-    if(tidLast == -1){
-        tidAssigned[tID=tidLast=0] = true;
-    }else{
-        int i = (tidLast + 1) % MaxNumThreads;
-        while (i != tidLast && tidAssigned[i])
-            i = (i + 1) % MaxNumThreads;
-        ASSERT(!tidAssigned[i]); // must find one
-        tidAssigned[tID=tidLast=i] = true;
-    }
-    tid2ptr[tID] = this;
+    tID = table.Allocate(this);
 
     stackTop = NULL;
     stack = NULL;
@@ -104,8 +84,10 @@ Thread::~Thread()
     DEBUG('t', "Deleting thread \"%s\"\n", name);
 
     ASSERT(this != currentThread);
+    if (status == JUST_CREATED)		// never forked, so never finished
+	table.Free(tID);
     if (stack != NULL)
-	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+	FreeStack(stack);
 }
 
 //----------------------------------------------------------------------
@@ -192,11 +174,12 @@ Thread::Finish ()
     
 #ifdef USER_PROGRAM
     delete space;
+    space = NULL;			// nothing to save when switching
 #endif // USER_PROGRAM
 
-    totalNum--;
-    tidAssigned[tID] = false;
-    tid2ptr[tID] = NULL;
+    if (period > 0)
+	rtLoad -= divRoundUp(budget * RTLoadScale, period);
+    table.Free(tID);
     threadToBeDestroyed = currentThread;
     Sleep();					// invokes SWITCH
     // not reached
@@ -229,25 +212,17 @@ Thread::Yield ()
     
     DEBUG('t', "Yielding thread \"%s\"\n", getName());
     
+    scheduler->Stopped(this);
     Thread *nextThread = scheduler->FindNextToRun();
-    if (nextThread != NULL){
-#ifdef SCHED_PRI_PRMPT
-        if (nextThread->getPriority() <= currentThread->getPriority()){
-            scheduler->ReadyToRun(this);
-            scheduler->Run(nextThread);
-        } else{
-            scheduler->ReadyToRun(nextThread, true); // send it back
-        }
-#else // SCHED_NAIVE, SCHED_RR
+    if (nextThread != NULL && scheduler->YieldsTo(nextThread)){
         scheduler->ReadyToRun(this);
         scheduler->Run(nextThread);
-#endif
     }else{
-#ifdef SCHED_RR
+        if (nextThread != NULL)
+            scheduler->ReadyToRun(nextThread, true); // send it back
         // didn't find any thread to which to yield the CPU, thus
-        // reset runningSince and continue to run.
-        RecordTime(stats->totalTicks);
-#endif
+        // start a new time slice and continue to run.
+        scheduler->Dispatched(this);
     }
     
     (void) interrupt->SetLevel(oldLevel);
@@ -282,13 +257,130 @@ Thread::Sleep ()
     
     DEBUG('t', "Sleeping thread \"%s\"\n", getName());
 
+    scheduler->Stopped(this);
     status = BLOCKED;
-    while ((nextThread = scheduler->FindNextToRun()) == NULL)
+    while ((nextThread = scheduler->FindNextToRun()) == NULL) {
+	if (scheduler->RunOtherCPU())
+	    return;		// another CPU has woken us up, and run us
 	interrupt->Idle();	// no one to run, wait for an interrupt
+    }
         
     scheduler->Run(nextThread); // returns when we've been signalled
 }
 
+//----------------------------------------------------------------------
+// Thread::setPriority
+// 	Make the thread run at priority "p" from now on.  A thread waiting
+//	for a lock is counted at its new priority among the waiters, and 
+//	a ready thread moves to the ready list of its new priority.
+//
+//	Assumes that interrupts are disabled.
+//----------------------------------------------------------------------
+
+void
+Thread::setPriority(int p)
+{
+    int oldPri = pri;
+
+    ASSERT(p >= 0 && p < NumPriLevels);
+    if (p == oldPri)
+	return;
+    DEBUG('t', "Thread \"%s\" now runs at priority %d\n", name, p);
+    if (waitingFor != NULL)
+	waitingFor->Requeue(oldPri, p);
+    pri = p;
+    if (status == READY)
+	scheduler->Reprioritize(this, oldPri);
+}
+
+//----------------------------------------------------------------------
+// Thread::InheritedPriority
+// 	Return the priority the thread should run at: the highest of its
+//	own, and those of the threads waiting for the locks it holds.
+//----------------------------------------------------------------------
+
+int
+Thread::InheritedPriority()
+{
+    int p = basePri;
+
+    for (Lock *lock = heldLocks; lock != NULL; lock = lock->nextHeld)
+	p = min(p, lock->TopWaiter());
+    return p;
+}
+
+//----------------------------------------------------------------------
+// Thread::SetRealTime
+// 	Make the thread periodic: a job of at most "b" ticks is released
+//	every "p" ticks, and is due by the start of the next period.  Its
+//	first job is released now.  With "p" = 0, it is no longer periodic.
+//
+//	Admission test: under EDF, periodic jobs due by the end of their
+//	period all meet their deadlines iff their loads (budget over
+//	period) add up to at most one CPU.  If this thread would take the
+//	total over that, it is left as it was and FALSE is returned.
+//----------------------------------------------------------------------
+
+bool
+Thread::SetRealTime(int p, int b)
+{
+    int load = (p > 0) ? divRoundUp(b * RTLoadScale, p) : 0;
+    int oldLoad = (period > 0) ? divRoundUp(budget * RTLoadScale, period) : 0;
+
+    ASSERT(p >= 0 && b >= 0 && b <= p);
+    if (rtLoad - oldLoad + load > RTLoadScale) {
+	DEBUG('t', "Real-time thread \"%s\" not admitted, load %d\n", 
+	      name, rtLoad - oldLoad + load);
+	return FALSE;
+    }
+    rtLoad += load - oldLoad;
+    period = p;
+    budget = b;
+    deadline = stats->totalTicks + p;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// ReleaseJob
+// 	Interrupt handler for the start of the next period of the
+//	real-time thread "arg", sleeping in WaitNextPeriod.
+//----------------------------------------------------------------------
+
+static void
+ReleaseJob(int arg)
+{
+    scheduler->ReadyToRun((Thread *)arg);
+}
+
+//----------------------------------------------------------------------
+// Thread::WaitNextPeriod
+// 	Called by a real-time thread when its current job is done: count
+//	a deadline miss if it is late, then sleep until the next job is
+//	released, at the deadline of this one.  A late thread goes on 
+//	with its next job at once.
+//----------------------------------------------------------------------
+
+void
+Thread::WaitNextPeriod()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    int now = stats->totalTicks, release = deadline;
+
+    ASSERT(this == currentThread && period > 0);
+    stats->numRTJobs++;
+    if (now > deadline) {
+	DEBUG('t', "Thread \"%s\" missed its deadline by %d ticks\n", 
+	      name, now - deadline);
+	stats->numDeadlineMisses++;
+    }
+    deadline += period;
+    if (release > now) {
+	interrupt->Schedule(ReleaseJob, (int)this, release - now, AlarmInt);
+	Sleep();
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
+
 //----------------------------------------------------------------------
 // ThreadFinish, InterruptEnable, ThreadPrint
 //	Dummy functions because C++ does not allow a pointer to a member
@@ -304,31 +396,17 @@ void ThreadPrint(int arg){ Thread *t = (Thread *)arg; t->Print(); }
 static void StartupRoutine() {
     DEBUG('t', "Now in StartupRoutine of thread \"%s\"\n", currentThread->getName());
 
-    if (threadToBeDestroyed != NULL) {
-        delete threadToBeDestroyed;
-	    threadToBeDestroyed = NULL;
-    }
-
-#ifdef SCHED_RR
     // Note that this should come before interrupt->Enable(), otherwise
-    // timer interrupt may appear before RecordTime.
-    currentThread->RecordTime(stats->totalTicks);
-#endif
-
-#ifdef USER_PROGRAM
-    if (currentThread->space != NULL) {	// if there is an address space
-        currentThread->RestoreUserState(); // to restore, do it.
-	    currentThread->space->RestoreState();
-    }
-#endif // USER_PROGRAM
+    // timer interrupt may appear before the time slice is started.
+    scheduler->Resumed();
 
     interrupt->Enable();
 }
 
 //----------------------------------------------------------------------
 // Thread::StackAllocate
-//	Allocate and initialize an execution stack.  The stack is
-//	initialized with an initial stack frame for ThreadRoot, which:
+//	Allocate (cf. NewStack) and initialize an execution stack.  The
+//	stack is initialized with an initial stack frame for ThreadRoot, which:
 //		enables interrupts
 //		calls (*func)(arg)
 //		calls Thread::Finish
@@ -340,7 +418,7 @@ static void StartupRoutine() {
 void
 Thread::StackAllocate (VoidFunctionPtr func, void *arg)
 {
-    stack = (int *) AllocBoundedArray(StackSize * sizeof(int));
+    stack = NewStack();
 
 #ifdef HOST_SNAKE
     // HP stack works from low addresses to high addresses
@@ -371,6 +449,42 @@ Thread::StackAllocate (VoidFunctionPtr func, void *arg)
     machineState[WhenDonePCState] = (int*)ThreadFinish;
 }
 
+//----------------------------------------------------------------------
+// Thread::NewStack, FreeStack, PrewarmStacks
+//	Keep the stacks of finished threads in a pool, for new threads,
+//	so that short-lived threads do not allocate and free a stack
+//	each.  The pool holds StackPoolSize stacks at most; stacks
+//	beyond that are freed.
+//----------------------------------------------------------------------
+
+int *
+Thread::NewStack()
+{
+    if (numPooled > 0) {
+	stats->numStackHits++;
+	return stackPool[--numPooled];
+    }
+    stats->numStackMisses++;
+    return (int *) AllocBoundedArray(StackSize * sizeof(int));
+}
+
+void
+Thread::FreeStack(int *stk)
+{
+    if (numPooled < StackPoolSize)
+	stackPool[numPooled++] = stk;
+    else
+	DeallocBoundedArray((char *) stk, StackSize * sizeof(int));
+}
+
+void
+Thread::PrewarmStacks(int n)
+{
+    while (n-- > 0 && numPooled < StackPoolSize)
+	stackPool[numPooled++] = 
+			(int *) AllocBoundedArray(StackSize * sizeof(int));
+}
+
 #ifdef USER_PROGRAM
 #include "machine.h"
 
@@ -408,42 +522,160 @@ Thread::RestoreUserState()
 #endif
 
 //----------------------------------------------------------------------
-// Thread::isTimeExpired
-//	Check if time slice is used up.
-// This routine is called by timer interrupt handler periodically.
+// ThreadTable::ThreadTable
+// 	The table is empty; it is allocated by the first Allocate.
+//----------------------------------------------------------------------
+
+ThreadTable::ThreadTable()
+{
+    size = numUsed = 0;
+    ptr = NULL;
+    gen = exitCode = nextFree = NULL;
+    freeHead = freeTail = -1;
+}
+
+ThreadTable::~ThreadTable()
+{
+    delete [] ptr;
+    delete [] gen;
+    delete [] exitCode;
+    delete [] nextFree;
+}
+
+//----------------------------------------------------------------------
+// ThreadTable::Grow
+// 	Double the table (or allocate the first TidTableInit tids), and
+//	put the new tids at the end of the free FIFO, in order.
 //----------------------------------------------------------------------
-#ifdef SCHED_RR
-    bool Thread::isTimeExpired(int now){
-        return (now - runningSince) >= TimeSlice;
+
+void
+ThreadTable::Grow()
+{
+    int i, newSize = (size == 0) ? TidTableInit : 2 * size;
+    Thread **newPtr = new Thread*[newSize];
+    int *newGen = new int[newSize];
+    int *newExitCode = new int[newSize];
+    int *newNextFree = new int[newSize];
+
+    ASSERT(newSize <= (1 << TidBits));
+    for (i = 0; i < size; i++) {
+	newPtr[i] = ptr[i];
+	newGen[i] = gen[i];
+	newExitCode[i] = exitCode[i];
+	newNextFree[i] = nextFree[i];
     }
-#endif
+    for (; i < newSize; i++) {
+	newPtr[i] = NULL;
+	newGen[i] = -1;			// 0 once first allocated
+	newExitCode[i] = 0;
+	newNextFree[i] = (i + 1 < newSize) ? i + 1 : -1;
+    }
+    if (freeTail == -1)
+	freeHead = size;
+    else
+	newNextFree[freeTail] = size;
+    freeTail = newSize - 1;
+
+    delete [] ptr;
+    delete [] gen;
+    delete [] exitCode;
+    delete [] nextFree;
+    ptr = newPtr;
+    gen = newGen;
+    exitCode = newExitCode;
+    nextFree = newNextFree;
+    size = newSize;
+}
+
+//----------------------------------------------------------------------
+// ThreadTable::Allocate
+// 	Assign the tid which has been free for the longest time to 
+//	"thread", growing the table if none is free, and return it.
+//	The tid starts a new generation.
+//----------------------------------------------------------------------
+
+int
+ThreadTable::Allocate(Thread *thread)
+{
+    int tid;
+
+    if (freeHead == -1)
+	Grow();
+    tid = freeHead;
+    freeHead = nextFree[tid];
+    if (freeHead == -1)
+	freeTail = -1;
+
+    ptr[tid] = thread;
+    gen[tid] = (gen[tid] + 1) & ((1 << (31 - TidBits)) - 1);
+    exitCode[tid] = 0;
+    numUsed++;
+    return tid;
+}
+
+//----------------------------------------------------------------------
+// ThreadTable::Free
+// 	The thread of "tid" has finished: put "tid" at the end of the
+//	free FIFO.  Its handle stays valid for ExitCode until it is reused.
+//----------------------------------------------------------------------
+
+void
+ThreadTable::Free(int tid)
+{
+    ASSERT(ptr[tid] != NULL);
+    ptr[tid] = NULL;
+    nextFree[tid] = -1;
+    if (freeTail == -1)
+	freeHead = tid;
+    else
+	nextFree[freeTail] = tid;
+    freeTail = tid;
+    numUsed--;
+}
+
+//----------------------------------------------------------------------
+// ThreadTable::Lookup, ExitCode
+// 	Check that "handle" is that of the current generation of its tid.
+//----------------------------------------------------------------------
+
+Thread *
+ThreadTable::Lookup(int handle)
+{
+    int tid = handle & ((1 << TidBits) - 1);
+
+    if (handle < 0 || tid >= size || Handle(tid) != handle)
+	return NULL;
+    return ptr[tid];
+}
+
+int
+ThreadTable::ExitCode(int handle)
+{
+    int tid = handle & ((1 << TidBits) - 1);
+
+    if (handle < 0 || tid >= size || Handle(tid) != handle ||
+							ptr[tid] != NULL)
+	return -1;
+    return exitCode[tid];
+}
 
 //----------------------------------------------------------------------
 // ThreadsStatus
 // Print out info and status of all existing threads in the format:
 // (in increasing order of tid)
-// user     tid     name    status      pri
-// ***      **      ***     ***         ***
-// ***      **      ***     ***         ***
+// user     tid     name    status      pri     level
+// ***      **      ***     ***         ***     ***
+// ***      **      ***     ***         ***     ***
 //----------------------------------------------------------------------
 void ThreadsStatus(){
-#ifdef SCHED_PRI_PRMPT
-    printf("user\t\ttid\t\tname\t\tstatus\t\tpriority\n");
-#else // SCHED_NAIVE, SCHED_RR
-    printf("user\t\ttid\t\tname\t\tstatus\n");
-#endif
+    printf("user\t\ttid\t\tname\t\tstatus\t\tpriority\tlevel\n");
 
-    for (int i = 0; i < MaxNumThreads; ++i){
-        if(Thread::tid2ptr[i] == NULL) continue;
-        Thread* ptr = Thread::tid2ptr[i];
+    for (int i = 0; i < Thread::table.Size(); ++i){
+        if(Thread::table.Get(i) == NULL) continue;
+        Thread* ptr = Thread::table.Get(i);
 
-#ifdef SCHED_PRI_PRMPT
-    printf("%s\t\t%d\t\t%s\t\t%s\t\t%d\n", ptr->uID, ptr->tID,
-            ptr->name, status_str[ptr->status], ptr->pri);
-#else // SCHED_NAIVE, SCHED_RR
-    printf("%s\t\t%d\t\t%s\t\t%s\n", ptr->uID, ptr->tID,
-            ptr->name, status_str[ptr->status]);
-#endif
+    printf("%s\t\t%d\t\t%s\t\t%s\t\t%d\t\t%d\n", ptr->uID, ptr->tID,
+            ptr->name, status_str[ptr->status], ptr->pri, ptr->level);
         
     }
 }
\ No newline at end of file
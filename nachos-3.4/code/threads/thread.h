@@ -39,17 +39,13 @@
 
 #include "copyright.h"
 #include "utility.h"
+#include "list.h"
 
 #ifdef USER_PROGRAM
 #include "machine.h"
 #include "addrspace.h"
 #endif
 
-// choose the scheduler algo here
-#define SCHED_NAIVE // naive sched: FIFO, omitting priority
-// #define SCHED_PRI_PRMPT // preemptive sched based on priority
-// #define SCHED_RR // Round-Robin
-
 // CPU register state to be saved on context switch.  
 // The SPARC and MIPS only need 10 registers, but the Snake needs 18.
 // For simplicity, this is just the max over all architectures.
@@ -60,18 +56,32 @@
 // WATCH OUT IF THIS ISN'T BIG ENOUGH!!!!!
 #define StackSize	(4 * 1024)	// in words
 
+// Stacks of finished threads are kept for new threads, rather than
+// freed, up to StackPoolSize of them; StackPoolPrewarm are allocated 
+// at startup.
+#define StackPoolSize		128
+#define StackPoolPrewarm	16
 
-// Maximum #threads existing in Nachos
-#ifdef INV_PG // support VM
-// assume each thread will run a user prog, and the thread finishes 
-// when the user prog exits.
-#define MaxNumThreads (NumPhysPages / ResSize)
-#else // do not support VM
-#define MaxNumThreads 128
-#endif // INV_PG
+// There is no limit on the number of threads, but a tid must fit in
+// TidBits bits.
+#define TidBits		16	// a handle is (generation << TidBits) | tid
+#define TidTableInit	64	// # of tids in the table at first
 
 // Valid priority levels are: 0,1,...,NumPriLevels-1
+// (it may be set in the Makefile, e.g. -DNumPriLevels=64)
+#ifndef NumPriLevels
 #define NumPriLevels 4
+#endif
+
+// Tickets of a user or thread, for proportional share scheduling
+// (cf. StridePolicy in schedpolicy.h)
+#define DefaultTickets	100
+#define MaxTickets	1024
+
+// Real-time threads may together use at most the whole CPU: the load
+// of each (its budget over its period) is counted in RTLoadScale-ths
+// of a CPU (cf. Thread::SetRealTime, and EDFPolicy in schedpolicy.h).
+#define RTLoadScale	10000
 
 // Thread state
 enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED };
@@ -79,6 +89,52 @@ enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED };
 // external function, dummy routine whose sole job is to call Thread::Print
 extern void ThreadPrint(int arg);	 
 
+class Thread;
+class Lock;
+
+// The following class keeps every existing thread, by thread id.  The
+// tids of finished threads are reused, in FIFO order so that a tid 
+// stays unused for as long as possible.  The table doubles when no tid
+// is free, so assigning and freeing a tid take (amortized) constant 
+// time, however many threads there are.
+//
+// A handle tags a tid with its generation, which changes each time the
+// tid is reused: a handle kept after its thread has finished (e.g. to
+// Join it) is never taken for the thread now using the tid.  The exit
+// code of a finished thread is kept until its tid is reused.
+
+class ThreadTable {
+  public:
+    ThreadTable();			// the table is empty
+    ~ThreadTable();
+
+    int Allocate(Thread *thread);	// return a free tid for "thread"
+    void Free(int tid);			// the thread of "tid" has finished
+
+    int Size() { return size; }		// tids are 0 .. Size()-1
+    int NumThreads() { return numUsed; } // # of tids in use
+    Thread *Get(int tid) { return ptr[tid]; } // NULL if not in use
+
+    int Handle(int tid) { return (gen[tid] << TidBits) | tid; }
+    Thread *Lookup(int handle);		// the thread of "handle", or NULL
+					// if it has finished
+    void SetExitCode(int tid, int code) { exitCode[tid] = code; }
+    int ExitCode(int handle);		// exit code of the finished thread
+					// of "handle", or -1 if unknown
+
+  private:
+    void Grow();			// double the table, freeing the 
+					// new tids
+
+    int size;				// # of tids
+    int numUsed;			// # of tids in use
+    Thread **ptr;			// thread of each tid, or NULL
+    int *gen;				// generation of each tid
+    int *exitCode;			// exit code of the last thread
+    int *nextFree;			// next free tid in the FIFO, or -1
+    int freeHead, freeTail;		// first and last free tids, or -1
+};
+
 // The following class defines a "thread control block" -- which
 // represents a single thread of execution.
 //
@@ -98,12 +154,8 @@ class Thread {
     void *machineState[MachineStateSize];  // all registers except for stackTop
 
   public:
-#ifdef SCHED_PRI_PRMPT
     Thread(char* debugName, int priority=(NumPriLevels-1),
            char* userid="root");		// initialize a Thread 
-#else // SCHED_NAIVE, SCHED_RR
-    Thread(char* debugName, char* userid="root");		// initialize a Thread
-#endif
     ~Thread(); 				// deallocate a Thread
 					// NOTE -- thread being deleted
 					// must not be running when delete 
@@ -124,16 +176,34 @@ class Thread {
     char* getName() { return (name); }
     char* getUserID() {return uID;}
     int getThreadID() {return tID;}
-#ifdef SCHED_PRI_PRMPT
+    int getHandle() {return table.Handle(tID);}
     int getPriority() {return pri;}
-#endif
+    int getBasePriority() {return basePri;}
+    void setPriority(int p);		// change the priority it runs at,
+					// e.g. inherited through a Lock
+    int InheritedPriority();		// its own priority, or that of the
+					// highest waiter for its locks
+    ThreadStatus getStatus() {return status;}
+    int getLevel() {return level;}
+    void setLevel(int lvl) {level = lvl;}
+    int getCPU() {return cpu;}
+    void setCPU(int c) {cpu = c;}
+    int getTickets() {return tickets;}
+    void setTickets(int t) {ASSERT(t >= 1 && t <= MaxTickets); tickets = t;}
+    int getPass() {return pass;}
+    void setPass(int p) {pass = p;}
+    bool SetRealTime(int p, int b);	// run a job of at most "b" ticks
+					// every "p" ticks, if admitted
+    void WaitNextPeriod();		// the job is done: wait for the
+					// next period
+    bool isRealTime() {return period > 0;}
+    int getDeadline() {return deadline;}
     void Print() { printf("%s, ", name); }
 
-#ifdef SCHED_RR
     void RecordTime(int now) {runningSince = now;}
           // update runningSince
-    bool isTimeExpired(int now); // check if time slice is used up
-#endif
+    int RunningTime(int now) {return now - runningSince;}
+          // ticks used of the current time slice
 
     friend void ThreadsStatus(); 
           // print out info and status of all existing threads
@@ -148,33 +218,44 @@ class Thread {
     char* name;
     char* uID; // user ID
     int tID; // thread ID
-#ifdef SCHED_PRI_PRMPT
     int pri; // non-negative priority number, 
       // smaller number for higher priority
-#endif
-#ifdef SCHED_RR
+    int basePri; // the priority it was created with; "pri" is higher
+      // while it holds a lock a higher priority thread waits for
+    Lock *heldLocks; // the locks it holds (cf. Lock::nextHeld)
+    Lock *waitingFor; // the lock it is waiting for, if any
+
+    friend class Lock;
+    int level; // queue of the mlfq scheduling policy, 0 for the top
+    int cpu; // the CPU it last ran on, or whose ready list it is on,
+      // -1 if it has not run yet
+    int tickets; // share of the CPU among the threads of its user
+    int pass; // virtual time of the stride scheduling policy
+    int period, budget; // of a real-time thread; period is 0 otherwise
+    int deadline; // when the current job of a real-time thread is due
     int runningSince; // Record the time the thread got scheduled
         // on CPU, examined by timer interrupt handler for time
         // slicing.
-#endif
     
     void StackAllocate(VoidFunctionPtr func, void *arg);
     					// Allocate a stack for thread.
 					// Used internally by Fork()
 
-    static int totalNum; // record the total #threads existing in Nachos
-          // get inc when new thread is created (in Thread constructor)
-          // get dec when a thread finishes (in thread->Finish())
+    static int *NewStack();		// a stack from the pool, if any
+    static void FreeStack(int *stk);	// put it back in the pool, unless
+					// the pool is full
+    static int *stackPool[StackPoolSize]; // stacks of finished threads
+    static int numPooled;		// # of stacks in the pool
+    static int rtLoad;			// load of the real-time threads
 
-    // tidAssigned and tidLast are used to tell what is the tid
-    // the next created thread is about to assume.
-    static bool tidAssigned[MaxNumThreads];
-          // records whether a tid has been assigned to an existing thread
-    static int tidLast;
-          // tid of the last created thread. (initialized to -1)
   public:
-    static Thread* tid2ptr[MaxNumThreads]; 
-          // record the pointer to each Thread instance
+    static ThreadTable table;
+          // every existing thread, by tid
+
+    ListLink<Thread> link;		// on the ready list, or on the wait
+					// list of a Semaphore or Condition
+
+    static void PrewarmStacks(int n);	// put n new stacks in the pool
 
 #ifdef USER_PROGRAM
 // A thread running a user program actually has *two* sets of CPU registers -- 
@@ -188,10 +269,6 @@ class Thread {
     void RestoreUserState();		// restore user-level register state
 
     AddrSpace *space;			// User code this thread is running.
-
-    static int tid2exitcode[MaxNumThreads]; 
-          // record the exit status of user program. default: 0.
-          // to tell whether a user prog has exited, look at "tid2ptr".
 #endif
 };
 
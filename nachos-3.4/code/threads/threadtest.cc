@@ -13,6 +13,7 @@
 #include "system.h"
 #include "elevatortest.h"
 #include "synch.h"
+#include "schedpolicy.h"
 
 // testnum is set in main.cc
 int testnum = 1;
@@ -99,12 +100,10 @@ ThreadTest2()
     // UpToCeiling(128);
 }
 
-#ifdef SCHED_PRI_PRMPT
-
 //----------------------------------------------------------------------
 // ThreadTest3
 // 	Almost same as ThreadTest1 except that this is to 
-//  test SCHED_PRI_PRMPT
+//  test the priority scheduling policy (run Nachos with "-sp priority")
 //----------------------------------------------------------------------
 
 void
@@ -120,13 +119,12 @@ ThreadTest3()
 
     SimpleThread(0);
 }
-#endif // SCHED_PRI_PRMPT
 
-#ifdef SCHED_RR
 
 //----------------------------------------------------------------------
 // ThreadTest4
-// 	
+// 	Threads which never yield: test time slicing (run Nachos with
+//  "-sp rr" or "-sp mlfq")
 //----------------------------------------------------------------------
 
 static int timeToQuit = 10000;
@@ -155,7 +153,6 @@ ThreadTest4()
 
     FakeSysCall(0);
 }
-#endif // SCHED_RR
 
 
 //----------------------------------------------------------------------
@@ -501,6 +498,240 @@ void ThreadTest9() {
 
 #endif // FILESYS
 
+//----------------------------------------------------------------------
+// ThreadTest10
+// 	Threads of two users which never block: test proportional share
+//  (run Nachos with "-sp stride" or "-sp lottery").  User "alice" has
+//  three times the tickets of "bob", so her threads should loop about
+//  three times as often as his; and her second thread, with twice the
+//  tickets of her first, about twice as often as that one.
+//----------------------------------------------------------------------
+
+void ShareLoop(int dummy){
+    int i = 0;
+    while (stats->totalTicks < timeToQuit) {
+        i++;
+        interrupt->SetLevel(IntOff);
+        interrupt->SetLevel(IntOn);
+    }
+    printf("*** thread \"%s\" of user %s looped %d times\n", 
+        currentThread->getName(), currentThread->getUserID(), i);
+}
+
+void ThreadTest10() {
+    DEBUG('t', "Entering ThreadTest10");
+
+    SetUserTickets("alice", 300);
+    SetUserTickets("bob", 100);
+    timeToQuit = 50 * TimeSlice;
+
+    Thread *t;
+    t = new Thread("alice1", NumPriLevels - 1, "alice");
+    t->Fork(ShareLoop, (void*)0);
+    t = new Thread("alice2", NumPriLevels - 1, "alice");
+    t->setTickets(2 * DefaultTickets);
+    t->Fork(ShareLoop, (void*)0);
+    t = new Thread("bob1", NumPriLevels - 1, "bob");
+    t->Fork(ShareLoop, (void*)0);
+}
+
+//----------------------------------------------------------------------
+// ThreadTest11
+// 	Periodic control loops under background load: test real-time
+//  scheduling (run Nachos with "-sp edf").  Two loops, using 70% of
+//  the CPU between them, should meet every deadline while two threads
+//  which never block take the rest; a third loop, which would need
+//  more than what is left, is not admitted and runs in the background.
+//----------------------------------------------------------------------
+
+#define ControlJobs	20		// jobs done by each control loop
+
+void ControlLoop(int budget){
+    for (int job = 0; job < ControlJobs; job++) {
+        for (int t = 0; t < budget; t += SystemTick) {
+            interrupt->SetLevel(IntOff);	// one SystemTick of work
+            interrupt->SetLevel(IntOn);
+        }
+        currentThread->WaitNextPeriod();
+    }
+    printf("*** control loop \"%s\" done at %d, %d deadline misses "
+        "so far\n", currentThread->getName(), stats->totalTicks,
+        stats->numDeadlineMisses);
+}
+
+void ThreadTest11() {
+    DEBUG('t', "Entering ThreadTest11");
+
+    timeToQuit = 20 * TimeSlice;
+
+    Thread *t;
+    t = new Thread("background1");
+    t->Fork(ShareLoop, (void*)0);
+    t = new Thread("background2");
+    t->Fork(ShareLoop, (void*)0);
+
+    t = new Thread("fast loop");
+    t->SetRealTime(TimeSlice / 2, TimeSlice / 10);
+    t->Fork(ControlLoop, (void*)(TimeSlice / 10));
+    t = new Thread("slow loop");
+    t->SetRealTime(2 * TimeSlice, TimeSlice);
+    t->Fork(ControlLoop, (void*)TimeSlice);
+
+    t = new Thread("greedy loop");
+    if (t->SetRealTime(TimeSlice, TimeSlice / 2))
+        t->Fork(ControlLoop, (void*)(TimeSlice / 2));
+    else {
+        printf("*** control loop \"%s\" not admitted\n", t->getName());
+        t->Fork(ShareLoop, (void*)0);
+    }
+}
+
+//----------------------------------------------------------------------
+// ThreadTest12
+// 	Priority inversion: test priority inheritance (run Nachos with
+//  "-sp priority").  A low priority thread takes a lock, a high 
+//  priority thread waits for it, then a medium priority thread gets
+//  ready to compute.  The low thread should inherit the high priority,
+//  release the lock, and let the high thread go on before the medium
+//  one runs.
+//----------------------------------------------------------------------
+
+static Lock *inversionLock;
+
+void InversionHigh(int dummy){
+    printf("*** high waits for the lock\n");
+    inversionLock->Acquire();
+    printf("*** high has the lock\n");
+    inversionLock->Release();
+}
+
+void InversionMedium(int dummy){
+    printf("*** medium runs\n");
+}
+
+void InversionLow(int dummy){
+    inversionLock->Acquire();
+    printf("*** low has the lock\n");
+    Thread *t = new Thread("high", 0);
+    t->Fork(InversionHigh, (void*)0);		// runs, and waits
+    t = new Thread("medium", 1);
+    t->Fork(InversionMedium, (void*)0);		// must not run yet
+    printf("*** low releases the lock, at priority %d\n", 
+        currentThread->getPriority());
+    inversionLock->Release();
+}
+
+void ThreadTest12() {
+    DEBUG('t', "Entering ThreadTest12");
+
+    inversionLock = new Lock("inversion");
+    Thread *t = new Thread("low", NumPriLevels - 1);
+    t->Fork(InversionLow, (void*)0);
+}
+
+//----------------------------------------------------------------------
+// ThreadTest13
+// 	Reader-writer lock.  Readers and writers, forked in turn, each
+//  hold the lock across a few yields; the readers holding it at once
+//  should overlap, the writers never.  The last reader upgrades to
+//  write, then downgrades.  Tests 13, 14 and 15 run it with writers
+//  first, readers first and fair (cf. RWPolicy).
+//----------------------------------------------------------------------
+
+#define RWThreads 6
+
+static RWLock *rwLock;
+static int rwReaders, rwWriters;	// # holding rwLock right now
+
+void RWReader(int which){
+    rwLock->AcquireRead();
+    rwReaders++;
+    ASSERT(rwWriters == 0);
+    printf("*** reader %d reads, with %d readers\n", which, rwReaders);
+    for (int i = 0; i < 3; i++)
+        currentThread->Yield();
+    if (which == RWThreads - 1) {
+        rwReaders--;
+        if (rwLock->Upgrade()) {
+            rwWriters++;
+            ASSERT(rwReaders == 0 && rwWriters == 1);
+            printf("*** reader %d upgraded to write\n", which);
+            currentThread->Yield();
+            rwWriters--;
+            rwLock->Downgrade();
+        }
+        rwReaders++;
+    }
+    rwReaders--;
+    rwLock->ReleaseRead();
+}
+
+void RWWriter(int which){
+    rwLock->AcquireWrite();
+    rwWriters++;
+    ASSERT(rwReaders == 0 && rwWriters == 1);
+    printf("*** writer %d writes\n", which);
+    for (int i = 0; i < 3; i++)
+        currentThread->Yield();
+    rwWriters--;
+    rwLock->ReleaseWrite();
+}
+
+void ThreadTest13(RWPolicy policy) {
+    DEBUG('t', "Entering ThreadTest13");
+
+    rwLock = new RWLock("rwtest", policy);
+    for (int i = 0; i < RWThreads; i++) {
+        Thread *t = new Thread(i % 3 == 1 ? "writer" : "reader");
+        t->Fork(i % 3 == 1 ? RWWriter : RWReader, (void*)i);
+    }
+}
+
+//----------------------------------------------------------------------
+// ThreadTest16
+// 	Adaptive lock: run Nachos with "-cpus 2".  Two threads, on two
+//  CPUs, take turns holding an adaptive lock for a few ticks of work.
+//  A thread finding it busy while the other one runs should spin and,
+//  the critical section being shorter than the spin budget, mostly get
+//  the lock without sleeping; the statistics count both.
+//----------------------------------------------------------------------
+
+#define SpinRounds	20		// critical sections of each thread
+#define SpinHold	(2 * SystemTick) // ticks of work in each of them
+
+static Lock *spinLock;
+static int spinDone;			// # of threads done
+
+void SpinWorker(int which){
+    for (int round = 0; round < SpinRounds; round++) {
+        spinLock->Acquire();
+        for (int t = 0; t < SpinHold; t += SystemTick) {
+            interrupt->SetLevel(IntOff);	// one SystemTick of work
+            interrupt->SetLevel(IntOn);
+        }
+        spinLock->Release();
+        interrupt->SetLevel(IntOff);		// a little work outside
+        interrupt->SetLevel(IntOn);
+    }
+    if (++spinDone == 2)
+        printf("*** %d spins, %d of them got the lock, %d ticks spent "
+            "spinning\n", stats->numLockSpins, stats->numSpinAcquires,
+            stats->lockSpinTicks);
+}
+
+void ThreadTest16() {
+    DEBUG('t', "Entering ThreadTest16");
+
+    if (scheduler->NumCPUs() < 2)
+        printf("*** run with \"-cpus 2\": on one CPU, nothing spins\n");
+    spinLock = new Lock("spintest", TRUE);
+    spinDone = 0;
+    for (int i = 0; i < 2; i++) {
+        Thread *t = new Thread("spinner");
+        t->Fork(SpinWorker, (void*)i);
+    }
+}
+
 //----------------------------------------------------------------------
 // ThreadTest
 // 	Invoke a test routine.
@@ -516,16 +747,12 @@ ThreadTest()
     case 2:
 	ThreadTest2();
 	break;
-#ifdef SCHED_PRI_PRMPT
     case 3:
 	ThreadTest3();
 	break;
-#endif
-#ifdef SCHED_RR
     case 4:
 	ThreadTest4();
 	break;
-#endif
     case 5:
 	ThreadTest5();
 	break;
@@ -543,6 +770,27 @@ ThreadTest()
 	ThreadTest9();
 	break;
 #endif // FILESYS
+    case 10:
+	ThreadTest10();
+	break;
+    case 11:
+	ThreadTest11();
+	break;
+    case 12:
+	ThreadTest12();
+	break;
+    case 13:
+	ThreadTest13(RWPreferWriters);
+	break;
+    case 14:
+	ThreadTest13(RWPreferReaders);
+	break;
+    case 15:
+	ThreadTest13(RWFair);
+	break;
+    case 16:
+	ThreadTest16();
+	break;
     default:
 	printf("No test specified.\n");
 	break;
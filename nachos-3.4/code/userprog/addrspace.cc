@@ -18,11 +18,17 @@
 #include "copyright.h"
 #include "system.h"
 #include "addrspace.h"
-#include "noff.h"
+#ifdef INV_PG
+#include "pagerepl.h"
+#endif
 #ifdef HOST_SPARC
 #include <strings.h>
 #endif
 
+#ifdef INV_PG
+static SwapFile *swapFile = NULL;	// created with the first addrspace
+#endif
+
 //----------------------------------------------------------------------
 // SwapHeader
 // 	Do little endian to big endian conversion on the bytes in the 
@@ -58,9 +64,11 @@ SwapHeader (NoffHeader *noffH)
 //	only uniprogramming, and we have a single unsegmented page table
 //
 //	"executable" is the file containing the object code to load into memory
-//  "_tid" is the thread which will run this user prog
+//
+//  If there are not enough page frames for it, nothing else is set up:
+//  check HasMemory.
 //----------------------------------------------------------------------
-AddrSpace::AddrSpace(OpenFile *executable, int _tid, char *_cwd)
+AddrSpace::AddrSpace(OpenFile *executable, char *_cwd)
 {
     NoffHeader noffH;
     int i;
@@ -81,95 +89,44 @@ AddrSpace::AddrSpace(OpenFile *executable, int _tid, char *_cwd)
 						// to leave room for the stack
     numPages = divRoundUp(size, PageSize);
     size = numPages * PageSize;
-    DEBUG('a', "Initializing address space, num pages %d, size %d, tid %d\n", 
-					numPages, size, _tid);
+    DEBUG('a', "Initializing address space, num pages %d, size %d\n", 
+					numPages, size);
 
 // set up the translation, and copy the code and data segments into memory
 #ifdef INV_PG // use global inverted page table, thus support VM.
     // allocate a resident set for this user prog.
-    // there must be enough page frames since MaxNumThreads 
-    // is set as (NumPhysPages / ResSize).
-    int tmp = 0;
-    for (i = 0; i < NumPhysPages; i++) {
-        if (machine->invPageTable[i].tid == -1) {
-            ASSERT(machine->invPageTable[i].valid == FALSE);
-            machine->invPageTable[i].tid = _tid;
-            tmp++;
-            if (tmp == ResSize) break;
-        }
+    sid = machine->AllocResidentSet(ResSize);
+    if (sid == -1)
+        return;
+    if (swapFile == NULL)
+        swapFile = new SwapFile();
+    if (!swapFile->Attach()) {
+        machine->FreeResidentSet(sid);
+        sid = -1;
+        return;
     }
-    ASSERT(tmp == ResSize);
 
-    // create and open a swap file
-    char swapFileName[16] = "/swap/swap_";
-    sprintf(&swapFileName[11], "%d", _tid);
-    fileSystem->Create(swapFileName, SWAP);
+    // nothing is loaded now: pages are read from the executable when 
+    // they are first touched (cf. ReadPage), so keep it open
+    execFile = new OpenFile(executable->getHdrSector());
+    code = noffH.code;
+    initData = noffH.initData;
 
-    machine->swapFiles[_tid] = fileSystem->Open(swapFileName);
-    machine->ro_bmp[_tid] = new BitMap(numPages);
+    // no page is in swap yet
+    swapSlot = new int[numPages];
+    for (i = 0; i < (int) numPages; i++)
+        swapSlot[i] = -1;
 
-    // copy the contents of executable into swap file
-    char buff[PageSize]; // copy one page per one time
+    // if a page contains only codes, we could set it to be read-only.
+    ro_bmp = new BitMap(numPages);
     if (noffH.code.size > 0) {
-        int sz = noffH.code.size, // remaining bytes in file to be copied
-            pos = noffH.code.inFileAddr; // position within the file
-        unsigned int vpn = (unsigned) noffH.code.virtualAddr / PageSize,
-                     offset = (unsigned) noffH.code.virtualAddr % PageSize;
-        while (sz > 0) {
-            int block_size = min(PageSize - offset, sz);
-            executable->ReadAt(buff, block_size, pos);
-            machine->swapFiles[_tid]->WriteAt(
-                        buff, block_size, vpn * PageSize + offset);
-            if (block_size == PageSize) {       // if this page contains only codes,
-                machine->ro_bmp[_tid]->Mark(vpn); // we could set it to be read-only.
-            }
-            sz -= block_size;
-            pos += block_size;
-            vpn++;
-            offset = 0;
-        }
-    }
-    if (noffH.initData.size > 0) {
-        int sz = noffH.initData.size, // remaining bytes in file to be read
-            pos = noffH.initData.inFileAddr; // position within the file
-        unsigned int vpn = (unsigned) noffH.initData.virtualAddr / PageSize,
-                     offset = (unsigned) noffH.initData.virtualAddr % PageSize;
-        while (sz > 0) {
-            int block_size = min(PageSize - offset, sz);
-            executable->ReadAt(buff, block_size, pos);
-            machine->swapFiles[_tid]->WriteAt(
-                        buff, block_size, vpn * PageSize + offset);
-            sz -= block_size;
-            pos += block_size;
-            vpn++;
-            offset = 0;
-        }
-    }
-    if (noffH.uninitData.size > 0) {
-        int sz = noffH.uninitData.size, // remaining bytes in file to be read
-            pos = noffH.uninitData.inFileAddr; // position within the file
-        unsigned int vpn = (unsigned) noffH.uninitData.virtualAddr / PageSize,
-                     offset = (unsigned) noffH.uninitData.virtualAddr % PageSize;
-        while (sz > 0) {
-            int block_size = min(PageSize - offset, sz);
-            executable->ReadAt(buff, block_size, pos);
-            machine->swapFiles[_tid]->WriteAt(
-                        buff, block_size, vpn * PageSize + offset);
-            sz -= block_size;
-            pos += block_size;
-            vpn++;
-            offset = 0;
-        }
+        unsigned int first = divRoundUp(noffH.code.virtualAddr, PageSize),
+            last = divRoundDown(noffH.code.virtualAddr + noffH.code.size, 
+                                PageSize);
+        for (unsigned int vpn = first; vpn < last; vpn++)
+            ro_bmp->Mark(vpn);
     }
 
-    // set page repl-algo-dependent variables
-#ifdef PG_FIFO
-	// TODO
-#else // PG_LRU
-	for (int i = 0; i < ResSize; i++)
-        pg_lru[i] = -1;
-#endif // PG_FIFO
-
 #else // use normal page table, one per user prog. do not support VM.
     ASSERT(numPages <= machine->mem_bmp->NumClear()); // make sure there is 
                                     // enough memory for this user prog
@@ -187,6 +144,7 @@ AddrSpace::AddrSpace(OpenFile *executable, int _tid, char *_cwd)
         bzero(&machine->mainMemory[ppn * PageSize], PageSize);
                 // zero out the address space, to zero the unitialized 
                 // data segment and the stack segment
+        machine->InvalidateDecoded(ppn);
     }
 
     if (noffH.code.size > 0) {
@@ -236,23 +194,6 @@ AddrSpace::AddrSpace(OpenFile *executable, int _tid, char *_cwd)
 #endif // USE_TLB
 }
 
-//----------------------------------------------------------------------
-// CopyNachosFile
-// 	Copy the contents of the Nachos file "from" to the Nachos file "to"
-//----------------------------------------------------------------------
-static void
-CopyNachosFile(OpenFile *from, OpenFile *to)
-{
-    int amountRead;
-    char buffer[PageSize];
-    
-    from->Seek(0);
-    to->Seek(0);
-    // Copy the data in PageSize chunks
-    while ((amountRead = from->Read(buffer, PageSize)) > 0)
-	    to->Write(buffer, amountRead);
-}
-
 //----------------------------------------------------------------------
 // AddrSpace::AddrSpace
 // 	Create an address space by copying an existing one.
@@ -261,10 +202,9 @@ CopyNachosFile(OpenFile *from, OpenFile *to)
 //	memory.  For now, this is really simple (1:1), since we are
 //	only uniprogramming, and we have a single unsegmented page table
 //
-//  "old_tid" is the thread which owns the copied addrspace.
-//  "new_tid" is the thread which owns the new addrspace.
+//  As above, check HasMemory.
 //----------------------------------------------------------------------
-AddrSpace::AddrSpace(AddrSpace *space, int old_tid, int new_tid)
+AddrSpace::AddrSpace(AddrSpace *space)
 {
     int i, j;
 
@@ -273,71 +213,51 @@ AddrSpace::AddrSpace(AddrSpace *space, int old_tid, int new_tid)
 
 #ifdef INV_PG // use global inverted page table, thus support VM.
 
-    // allocate a resident set for the new addrspace.
-    // there must be enough page frames since MaxNumThreads 
-    // is set as (NumPhysPages / ResSize).
-    int tmp = 0;
-    for (i = 0; i < NumPhysPages; i++) {
-        if (machine->invPageTable[i].tid == -1) {
-            ASSERT(machine->invPageTable[i].valid == FALSE);
-            machine->invPageTable[i].tid = new_tid;
-            tmp++;
-            if (tmp == ResSize) break;
-        }
+    // allocate a resident set for the new addrspace, as large as the 
+    // one of the old addrspace if possible.
+    sid = machine->AllocResidentSet(machine->ResidentSize(space->sid));
+    if (sid == -1)
+        return;
+    swapFile->Attach();		// the old addrspace has it open already
+
+    // the pages never written to swap come from the same executable
+    execFile = new OpenFile(space->execFile->getHdrSector());
+    code = space->code;
+    initData = space->initData;
+    ro_bmp = new BitMap(space->ro_bmp);
+
+    // share the pages in swap, instead of copying them: from now on,
+    // neither addrspace writes to these slots (cf. WritePage)
+    swapSlot = new int[numPages];
+    for (i = 0; i < (int) numPages; i++) {
+        swapSlot[i] = space->swapSlot[i];
+        if (swapSlot[i] != -1)
+            swapFile->AddRef(swapSlot[i]);
     }
-    ASSERT(tmp == ResSize);
-
-    // copy invPageTable entries, contents of valid pages, and pg_next_repl, pg_lru
-#ifdef PG_LRU
-        for (int k = 0; k < ResSize; k++)
-            pg_lru[k] = -1;
-#endif // PG_LRU
-    i = j = 0;
-    while (TRUE) {
-        for (; i < NumPhysPages; i++) {
-            if (machine->invPageTable[i].tid == old_tid)
-                break;
-        }
-        for (; j < NumPhysPages; j++) {
-            if (machine->invPageTable[j].tid == new_tid)
-                break;
+
+    // copy invPageTable entries and the bookkeeping of the page 
+    // replacement policy, sharing the page frames of valid pages 
+    // copy-on-write.  If the new resident set is too small, the pages 
+    // left over are written to swap if they are dirty.
+    for (i = machine->FirstResident(space->sid); i != -1; 
+                                    i = machine->NextResident(i)) {
+        if (!machine->invPageTable[i].valid)
+            continue;
+        j = machine->FindInvalidEntry(sid);
+        if (j == -1) {
+            if (machine->invPageTable[i].dirty)
+                WritePage(machine->invPageTable[i].virtualPage, 
+                    &machine->mainMemory[machine->invPageTable[i].physicalPage
+                                            * PageSize]);
+            continue;
         }
-        if (i == NumPhysPages && j == NumPhysPages)
-            break;
-        ASSERT(i < NumPhysPages && j < NumPhysPages);
-        machine->invPageTable[j].virtualPage = machine->invPageTable[i].virtualPage;
-        machine->invPageTable[j].valid = machine->invPageTable[i].valid;
-        machine->invPageTable[j].readOnly = machine->invPageTable[i].readOnly;
+        machine->MapPage(j, machine->invPageTable[i].virtualPage);
+        machine->ShareFrame(j, i);
         machine->invPageTable[j].use = machine->invPageTable[i].use;
         machine->invPageTable[j].dirty = machine->invPageTable[i].dirty;
-        if (machine->invPageTable[j].valid)
-            memcpy(&machine->mainMemory[j * PageSize], 
-                    &machine->mainMemory[i * PageSize], PageSize);
-#ifdef PG_FIFO
-        if (space->pg_next_repl == i)
-            pg_next_repl = j;
-#else // PG_LRU
-        for (int k = 0; k < ResSize; k++) {
-            if (space->pg_lru[k] == i) {
-                pg_lru[k] = j;
-                break;
-            }
-        }
-#endif // PG_FIFO
-        i++; j++;
+        machine->replacer->CopyFrame(space->sid, i, sid, j);
     }
 
-    // create and open a swap file for the new addrspace
-    char swapFileName[16] = "/swap/swap_";
-    sprintf(&swapFileName[11], "%d", new_tid);
-    fileSystem->Create(swapFileName, SWAP);
-
-    machine->swapFiles[new_tid] = fileSystem->Open(swapFileName);
-    machine->ro_bmp[new_tid] = new BitMap(&machine->ro_bmp[old_tid]);
-
-    // copy swap file from old_tid to new_tid
-    CopyNachosFile(machine->swapFiles[old_tid], machine->swapFiles[new_tid]);
-
 #else
     // TODO: allow for normal page table
     ASSERT(FALSE);
@@ -354,27 +274,20 @@ AddrSpace::~AddrSpace()
 
 // clear memory bitmap
 #ifdef INV_PG // use global inverted page table, thus support VM.
-    int _tid = currentThread->getThreadID();
-    for (i = 0; i < NumPhysPages; i++) {
-        if (machine->invPageTable[i].tid == _tid) {
-            machine->invPageTable[i].tid = -1;
-            if (machine->invPageTable[i].valid) {
-                machine->mem_bmp->Clear(i);
-                machine->invPageTable[i].valid = FALSE;
-            }
-        }
-    }
+    if (sid == -1)  // it never got any memory, nor anything else
+        return;
+    machine->FreeResidentSet(sid);
 
-    // close and remove the swap file
-    
-    delete machine->swapFiles[_tid];
-    machine->swapFiles[_tid] = NULL;
-    delete machine->ro_bmp[_tid];
-    machine->ro_bmp[_tid] = NULL;
+    delete execFile;
+    delete ro_bmp;
 
-    char swapFileName[16] = "/swap/swap_";
-    sprintf(&swapFileName[11], "%d", _tid);
-    fileSystem->Remove(swapFileName);
+    // slots are freed when no addrspace needs them any more
+    for (i = 0; i < (int) numPages; i++) {
+        if (swapSlot[i] != -1)
+            swapFile->DelRef(swapSlot[i]);
+    }
+    delete [] swapSlot;
+    swapFile->Detach();
 
 #else // use normal page table, one per user prog. do not support VM.
     for (i = 0; i < numPages; i++) {
@@ -385,6 +298,208 @@ AddrSpace::~AddrSpace()
 #endif // INV_PG
 }
 
+#ifdef INV_PG
+//----------------------------------------------------------------------
+// ReadSegment
+// 	Copy into "into" the part of the segment "seg" of "executable"
+//	which lies in the virtual page "vpn", if any.
+//----------------------------------------------------------------------
+static void
+ReadSegment(OpenFile *executable, Segment *seg, int vpn, char *into)
+{
+    int start = max(seg->virtualAddr, vpn * PageSize),
+        end = min(seg->virtualAddr + seg->size, (vpn + 1) * PageSize);
+
+    if (start < end)
+        executable->ReadAt(&into[start - vpn * PageSize], end - start, 
+                            seg->inFileAddr + (start - seg->virtualAddr));
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ReadPage
+// 	Load the virtual page "vpn" into the page frame at "into".
+//	A page which was written to swap is read back from there;
+//	otherwise it still has its initial contents, which come from the
+//	code and initialized data segments of the executable, with zeros
+//	for the uninitialized data and the stack.
+//----------------------------------------------------------------------
+void
+AddrSpace::ReadPage(int vpn, char *into)
+{
+    ASSERT(vpn >= 0 && vpn < (int) numPages);
+    if (swapSlot[vpn] != -1) {
+        swapFile->ReadSlot(swapSlot[vpn], into);
+        return;
+    }
+    bzero(into, PageSize);
+    ReadSegment(execFile, &code, vpn, into);
+    ReadSegment(execFile, &initData, vpn, into);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::WritePage
+// 	Write the virtual page "vpn" from the page frame at "from" to
+//	swap; it will be read back from there from now on.
+//
+//	A slot shared with another addrspace is never written to: the
+//	page goes to a new slot, and the old copy is left to the others.
+//----------------------------------------------------------------------
+void
+AddrSpace::WritePage(int vpn, char *from)
+{
+    ASSERT(vpn >= 0 && vpn < (int) numPages);
+    if (swapSlot[vpn] != -1 && swapFile->Shared(swapSlot[vpn])) {
+        swapFile->DelRef(swapSlot[vpn]);
+        swapSlot[vpn] = -1;
+    }
+    if (swapSlot[vpn] == -1)
+        swapSlot[vpn] = swapFile->Alloc();
+    swapFile->WriteSlot(swapSlot[vpn], from);
+}
+
+//----------------------------------------------------------------------
+// SwapFile::SwapFile
+// 	There is one swap file per Nachos process; with "-j", the number
+//	of the UNIX process is in its name, as the processes share the 
+//	disk.  The file itself is created by Attach.
+//----------------------------------------------------------------------
+SwapFile::SwapFile()
+{
+    sprintf(name, "/swap/swap_%d", hostJob);
+    file = NULL;
+    numUsers = 0;
+    numSlots = 0;
+    refs = nextFree = NULL;
+    freeSlot = -1;
+}
+
+SwapFile::~SwapFile()
+{
+    ASSERT(numUsers == 0);
+    delete [] refs;
+    delete [] nextFree;
+}
+
+//----------------------------------------------------------------------
+// SwapFile::Attach
+// 	A new address space may write pages to swap: make sure the file
+//	is open.  A file left over by a Nachos process which did not 
+//	finish is simply reused, as no slot of it is in use.
+//	Return FALSE if the file cannot be created (e.g. the disk or
+//	"/swap" is full).
+//----------------------------------------------------------------------
+bool
+SwapFile::Attach()
+{
+    if (numUsers == 0) {
+        fileSystem->Create(name, SWAP);	// fails if it exists already
+        file = fileSystem->Open(name);
+        if (file == NULL) {
+            printf("Unable to create swap file \"%s\"\n", name);
+            return FALSE;
+        }
+    }
+    numUsers++;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// SwapFile::Detach
+// 	An address space is deleted, after freeing its slots.  After the
+//	last one, no slot is in use: close and remove the file.
+//----------------------------------------------------------------------
+void
+SwapFile::Detach()
+{
+    ASSERT(numUsers > 0);
+    if (--numUsers == 0) {
+        delete file;
+        file = NULL;
+        fileSystem->Remove(name);
+    }
+}
+
+//----------------------------------------------------------------------
+// SwapFile::Grow
+// 	Double the number of slots (or allocate the first SwapSlotsInit
+//	of them), and put the new ones in the free list.  The file 
+//	grows as they are written to.
+//----------------------------------------------------------------------
+void
+SwapFile::Grow()
+{
+    int i, newNum = (numSlots == 0) ? SwapSlotsInit : 2 * numSlots;
+    int *newRefs = new int[newNum], *newNext = new int[newNum];
+
+    for (i = 0; i < numSlots; i++) {
+        newRefs[i] = refs[i];
+        newNext[i] = nextFree[i];
+    }
+    for (; i < newNum; i++) {
+        newRefs[i] = 0;
+        newNext[i] = (i + 1 < newNum) ? i + 1 : freeSlot;
+    }
+    freeSlot = numSlots;
+    delete [] refs;
+    delete [] nextFree;
+    refs = newRefs;
+    nextFree = newNext;
+    numSlots = newNum;
+}
+
+//----------------------------------------------------------------------
+// SwapFile::Alloc
+// 	Return a free slot, which one page refers to.  The slot freed 
+//	last is reused first, so that the file stays small.
+//----------------------------------------------------------------------
+int
+SwapFile::Alloc()
+{
+    int slot;
+
+    if (freeSlot == -1)
+        Grow();
+    slot = freeSlot;
+    freeSlot = nextFree[slot];
+    ASSERT(refs[slot] == 0);
+    refs[slot] = 1;
+    return slot;
+}
+
+//----------------------------------------------------------------------
+// SwapFile::DelRef
+// 	One page less is in this slot; if it was the last one, nobody 
+//	needs the slot any more.
+//----------------------------------------------------------------------
+void
+SwapFile::DelRef(int slot)
+{
+    ASSERT(refs[slot] > 0);
+    if (--refs[slot] == 0) {
+        nextFree[slot] = freeSlot;
+        freeSlot = slot;
+    }
+}
+
+//----------------------------------------------------------------------
+// SwapFile::ReadSlot, WriteSlot
+// 	Read or write the page in "slot".
+//----------------------------------------------------------------------
+void
+SwapFile::ReadSlot(int slot, char *into)
+{
+    ASSERT(file != NULL && refs[slot] > 0);
+    file->ReadAt(into, PageSize, slot * PageSize);
+}
+
+void
+SwapFile::WriteSlot(int slot, char *from)
+{
+    ASSERT(file != NULL && refs[slot] == 1);
+    file->WriteAt(from, PageSize, slot * PageSize);
+}
+#endif // INV_PG
+
 //----------------------------------------------------------------------
 // AddrSpace::InitRegisters
 // 	Set the initial values for the user-level register set.
@@ -421,10 +536,15 @@ AddrSpace::InitRegisters()
 // 	On a context switch, save any machine state, specific
 //	to this address space, that needs saving.
 //
-//	For now, nothing!
+//	With virtual memory, stop the virtual time of the space, which
+//	measures its page fault frequency (cf. RestoreState).
 //----------------------------------------------------------------------
 void AddrSpace::SaveState() 
-{}
+{
+#ifdef INV_PG
+    machine->SpaceStops(sid);
+#endif // INV_PG
+}
 
 //----------------------------------------------------------------------
 // AddrSpace::RestoreState
@@ -432,14 +552,19 @@ void AddrSpace::SaveState()
 //	this address space can run.
 //
 //      For now, tell the machine where to find the page table.
+//      With virtual memory, start the virtual time of the space again.
 //----------------------------------------------------------------------
 void AddrSpace::RestoreState() 
 {
 #ifndef INV_PG // use normal page table, one per user prog. do not support VM.
     machine->pageTable = pageTable;
     machine->pageTableSize = numPages;
+#else
+    machine->SpaceRuns(sid);
 #endif // INV_PG
 
+    machine->FlushTransCache();
+
 #ifdef USE_TLB
     for (int i = 0; i < TLBSize; i++) // flush TLB
         machine->tlb[i].valid = false;
@@ -15,17 +15,71 @@
 
 #include "copyright.h"
 #include "filesys.h"
+#include "noff.h"
 
 #define UserStackSize		1024 	// increase this as necessary!
 
+#ifdef INV_PG
+#define SwapSlotsInit		32	// # of slots in the swap file at first
+
+// The swap file, shared by all address spaces: it holds the pages 
+// written out, one per slot of PageSize bytes.  After Fork, parent and
+// child refer to the same slots; a shared slot is never written to, the
+// page is written to a new slot instead.  A slot is reused as soon as
+// no page refers to it any more.  The file exists while there are 
+// address spaces.
+
+class SwapFile {
+  public:
+    SwapFile();				// no file yet, nor slots
+    ~SwapFile();
+
+    bool Attach();			// one more address space; create
+					// the file for the first one.
+					// FALSE if it cannot be created
+    void Detach();			// one less; remove the file after 
+					// the last one
+
+    int Alloc();			// a free slot, with one reference
+    void AddRef(int slot) { refs[slot]++; } // one more page refers to it
+    void DelRef(int slot);		// one less; free it at 0
+    bool Shared(int slot) { return refs[slot] > 1; }
+
+    void ReadSlot(int slot, char *into);
+    void WriteSlot(int slot, char *from);
+
+  private:
+    void Grow();			// double the number of slots
+
+    char name[24];			// "/swap/swap_<job>"
+    OpenFile *file;			// NULL if no address space
+    int numUsers;			// # of address spaces attached
+    int numSlots;			// # of slots in the tables below
+    int *refs;				// # of pages, over all address 
+					// spaces, in each slot
+    int *nextFree;			// next slot in the free list
+    int freeSlot;			// first free slot, or -1
+};
+#endif // INV_PG
+
 class AddrSpace {
   public:
-    AddrSpace(OpenFile *executable, int _tid, char *_cwd); // Create an address space,
+    AddrSpace(OpenFile *executable, char *_cwd); // Create an address space,
 					              // initializing it with the program
 					              // stored in the file "executable"
-    AddrSpace(AddrSpace *space, int old_tid, int new_tid); // Create an address space by copying one
+    AddrSpace(AddrSpace *space);	// Create an address space by copying one
     ~AddrSpace();			// De-allocate an address space
 
+#ifdef INV_PG
+    int getSpaceID() { return sid; }	// owner of its page frames
+    bool HasMemory() { return sid != -1; } // FALSE if there were not
+					// enough page frames (or no swap 
+					// file) to run it: it must be 
+					// deleted at once
+#else
+    bool HasMemory() { return TRUE; }
+#endif
+
     void InitRegisters();		// Initialize user-level CPU registers,
 					// before jumping to user code
 
@@ -38,24 +92,31 @@ class AddrSpace {
 	  int tlb_miss_cnt; // total times TLB misses in this user program
 #endif // USE_TLB
 
-#ifdef INV_PG
-// page replacement algorithm dependent variables
-#ifdef PG_FIFO
-	int pg_next_repl; // TODO
-#else // PG_LRU
-	int pg_lru[ResSize]; // pg_lru[0] is the least recently used (i.e. the one 
-			// to be replaced), while pg_lru[ResSize-1] is the most recently used.
-			// Note: initialized to all -1, representing invaid entry.
-#endif // PG_FIFO
-#endif // INV_PG
-
     unsigned int numPages; // Number of pages in the virtual 
 					                // address space
     char *currWorkDir; // current working directory
 
+#ifdef INV_PG
+    void ReadPage(int vpn, char *into); // Fill a page frame with page vpn,
+					// from swap if it was ever written there,
+					// else from the executable (and zeroes)
+    void WritePage(int vpn, char *from); // Save dirty page vpn to swap,
+					// in a slot private to this addrspace
+    int TextSector() { return execFile->getHdrSector(); }
+					// identifies the executable, for 
+					// sharing code pages (cf. FindTextPage)
+
+    BitMap *ro_bmp; // bitmap recording if each vpn is readOnly
+#endif // INV_PG
+
   private:
 #ifndef INV_PG // use normal page table, one per user prog. do not support VM.
     TranslationEntry *pageTable;
+#else
+    int sid; // the space id of the resident set, or -1 if none
+    OpenFile *execFile; // the executable, kept open to page in from it
+    Segment code, initData; // where they are in the executable
+    int *swapSlot; // for each vpn, its slot in the swap file, or -1
 #endif
 };
 
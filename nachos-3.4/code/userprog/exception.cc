@@ -24,89 +24,33 @@
 #include "copyright.h"
 #include "system.h"
 #include "syscall.h"
+#ifdef INV_PG
+#include "pagerepl.h"
+#endif
 
 // Get string starting at virtual address "addr".
 // Don't forget to delete the returned string outside this function!
 static char *
 getStrArg(int addr)
 {
-    int data;
-    int len = 0;
-    // get str length
-    while (TRUE) {
-        while (TRUE) // allow for possible pagefault exceptions
-            if (machine->ReadMem(addr + len, 1, &data))
-                break;
-        if (((char)data) == '\0')
-            break;
-        len++;
-    }
-    // get str
-    char *str = new char[len + 1];
-    for (int i = 0; i < len; i++) {
-        while (TRUE) // allow for possible pagefault exceptions
-            if (machine->ReadMem(addr + i, 1, &data))
-                break;
-        str[i] = (char)data;
-    }
-    str[len] = '\0';
-    return str;
-}
-
-// Read "size" bytes into "buff" from simulated memory,
-// starting from virtual address "addr".
-// Note: make sure that buff is big enough.
-static void
-ReadMemManyBytes(int addr, int size, char *buff)
-{
-    int data;
-    for (int i = 0; i < size; i++) {
-        while (TRUE) // allow for possible pagefault exceptions
-            if (machine->ReadMem(addr + i, 1, &data))
-                break;
-        buff[i] = (char)data;
-    }
-}
-
-// Write "size" bytes from "buff" to simulated memory,
-// starting from virtual address "addr".
-static void
-WriteMemManyBytes(int addr, int size, char *buff)
-{
-    for (int i = 0; i < size; i++) {
-        while (TRUE) // allow for possible pagefault exceptions
-            if (machine->WriteMem(addr + i, 1, (int)(buff[i])))
-                break;
+    int size = 64;
+    char *str;
+
+    while (TRUE) { // try again with a larger buffer, until it fits
+        str = new char[size];
+        if (machine->CopyInString(addr, size, str) < size)
+            return str;
+        delete[] str;
+        size *= 2;
     }
 }
 
-// arg structure used in syscall Exec
-struct ArgStruct
-{
-    char *filename;
-    char *currWorkDir;
-};
-
-// procedure mimics StartProcess, executed by threads forked in syscall Exec
+// procedure mimics StartProcess, executed by threads forked in syscall Exec;
+// the address space was set up by Exec
 static void
-StartProcessFromExec (int arg)
+StartProcessFromExec (int dummy)
 {
-    ArgStruct *argStruct = (ArgStruct *)arg;
-
-    OpenFile *executable = fileSystem->Open(argStruct->filename);
-    if (executable == NULL) {
-        printf("Unable to open file \"%s\"\n", argStruct->filename);
-        delete[] argStruct->filename;
-        delete argStruct;
-        return;
-    }
-
-    AddrSpace *space = new AddrSpace(executable, currentThread->getThreadID(),
-                                    argStruct->currWorkDir);
-    currentThread->space = space;
-    delete executable; // close file
-    delete[] argStruct->filename;
-    delete argStruct;
+    AddrSpace *space = currentThread->space;
 
     space->InitRegisters();		// set the initial register values
     space->RestoreState();		// load page table register
@@ -167,7 +111,6 @@ ExceptionHandler(ExceptionType which)
         OpenFile *openFile;
         AddrSpace *space;
         Thread *thread;
-        ArgStruct *argStruct;
         switch (type) {
 
           case SC_Halt:
@@ -184,7 +127,7 @@ ExceptionHandler(ExceptionType which)
             arg1 = machine->ReadRegister(4);
             printf("User program (tid=%d) exits with code: %d\n", 
                     currentThread->getThreadID(), arg1);
-            Thread::tid2exitcode[currentThread->getThreadID()] = arg1;
+            Thread::table.SetExitCode(currentThread->getThreadID(), arg1);
             currentThread->Finish();
             break; // never reached
 
@@ -233,7 +176,7 @@ ExceptionHandler(ExceptionType which)
             arg2 = machine->ReadRegister(5); // # of bytes
             arg3 = machine->ReadRegister(6); // OpenFileId
             buff = new char[arg2];
-            ReadMemManyBytes(arg1, arg2, buff);
+            machine->CopyIn(arg1, arg2, buff);
 
             if (arg3 == ConsoleInput) {
                 printf("Cannot Write to ConsoleInput!\n");
@@ -275,7 +218,7 @@ ExceptionHandler(ExceptionType which)
                 openFile = (OpenFile *)arg3;
                 len = openFile->Read(buff, arg2);
             }
-            WriteMemManyBytes(arg1, len, buff);
+            machine->CopyOut(arg1, len, buff);
             delete[] buff;
 
             machine->WriteRegister(2, len);
@@ -298,18 +241,36 @@ ExceptionHandler(ExceptionType which)
             arg1 = machine->ReadRegister(4);
             str = getStrArg(arg1);
             len = strlen(currentThread->space->currWorkDir) + strlen(str);
-            argStruct = new ArgStruct; // to be deleted in "StartProcessFromExec"
-            argStruct->filename = new char[len + 1]; 
-                                    // to be deleted in "StartProcessFromExec"
-            strcpy(argStruct->filename, currentThread->space->currWorkDir);
-            strcat(argStruct->filename, str);
-            argStruct->currWorkDir = currentThread->space->currWorkDir;
+            filename = new char[len + 1];
+            strcpy(filename, currentThread->space->currWorkDir);
+            strcat(filename, str);
             delete[] str;
 
+            // load the program here, so that Exec can fail if the
+            // file does not exist, or if there is no memory for it
+            openFile = fileSystem->Open(filename);
+            if (openFile == NULL) {
+                printf("Unable to open file \"%s\"\n", filename);
+                delete[] filename;
+                machine->WriteRegister(2, -1);
+                machine->UpdatePCinSyscall(); // increment the pc
+                break;
+            }
+            delete[] filename;
+            space = new AddrSpace(openFile, currentThread->space->currWorkDir);
+            delete openFile; // close file
+            if (!space->HasMemory()) {
+                printf("Not enough memory to run a new program\n");
+                delete space;
+                machine->WriteRegister(2, -1);
+                machine->UpdatePCinSyscall(); // increment the pc
+                break;
+            }
             thread = new Thread("forked");
-            thread->Fork(StartProcessFromExec, (void *)argStruct);
+            thread->space = space;
+            thread->Fork(StartProcessFromExec, (void *)0);
 
-            machine->WriteRegister(2, thread->getThreadID());
+            machine->WriteRegister(2, thread->getHandle());
             machine->UpdatePCinSyscall(); // increment the pc
             break;
 
@@ -318,10 +279,17 @@ ExceptionHandler(ExceptionType which)
 
             arg1 = machine->ReadRegister(4); // "void (*func)()"
 
+            space = new AddrSpace(currentThread->space);
+            if (!space->HasMemory()) {
+                printf("Not enough memory to fork\n");
+                delete space;
+                machine->WriteRegister(2, -1);
+                machine->UpdatePCinSyscall(); // increment the pc
+                break;
+            }
             thread = new Thread("forked");
-            space = new AddrSpace(currentThread->space, currentThread->getThreadID(), 
-                                    thread->getThreadID());
             thread->space = space;
+            machine->WriteRegister(2, 0);
             machine->UpdatePCinSyscall(); // increment the pc
             thread->SaveUserState();
             thread->Fork(StartProcessFromFork, arg1);
@@ -337,14 +305,13 @@ ExceptionHandler(ExceptionType which)
           case SC_Join:
             DEBUG('a', "In Syscall Join.\n");
 
-            arg1 = machine->ReadRegister(4); // thread id
-            ASSERT(arg1 >= 0 && arg1 < MaxNumThreads);
+            arg1 = machine->ReadRegister(4); // thread handle, from Exec
 
-            while (Thread::tid2ptr[arg1] != NULL) {
+            while (Thread::table.Lookup(arg1) != NULL) {
                 currentThread->Yield();
             }
             
-            machine->WriteRegister(2, Thread::tid2exitcode[arg1]);
+            machine->WriteRegister(2, Thread::table.ExitCode(arg1));
             machine->UpdatePCinSyscall(); // increment the pc
             break;
             
@@ -417,43 +384,50 @@ ExceptionHandler(ExceptionType which)
                             // update TLB if TLB is in use.
             // Note: Only using inverted page table can lead us here.
 #ifdef INV_PG
-            int tid = currentThread->getThreadID();
+            AddrSpace *space = currentThread->space;
+            int sid = space->getSpaceID();
+            stats->numPageFaults++;
+            // grow or shrink the resident set, by page fault frequency
+            machine->AdjustResidentSet(sid);
             // search any invalid page frame in the resident set
             TranslationEntry *pg_entry;
-            int ppn = machine->FindInvalidEntry(tid);
+            int ppn = machine->FindInvalidEntry(sid);
             if (ppn != -1) { // found
                 pg_entry = &machine->invPageTable[ppn];
-#ifdef PG_LRU // update pg_lru
-                int j;
-                for (j = 0; j < ResSize; j++) {
-                    if (currentThread->space->pg_lru[j] == -1) { 
-                        currentThread->space->pg_lru[j] = ppn;
-                        break;
-                    }
-                }
-                ASSERT(j < ResSize); // must found one pg_lru elem
-#endif // PG_LRU 
             } else { // not found, we should replace one page frame
-                ppn = machine->FindReplEntry(tid);
+                ppn = machine->FindReplEntry(sid);
                 pg_entry = &machine->invPageTable[ppn];
+                stats->numPageReplacements++;
                 // write back if necessary
                 if (pg_entry->dirty) {
-                    machine->swapFiles[tid]->WriteAt(
-                        &machine->mainMemory[ppn * PageSize],
-                        PageSize, pg_entry->virtualPage * PageSize);                    
+                    space->WritePage(pg_entry->virtualPage, &machine->mainMemory[
+                                        pg_entry->physicalPage * PageSize]);
+                    stats->numPageOuts++;
                 }
+                machine->UnmapPage(ppn); // nobody may use or steal it
+                                         // while the new page is read
+            }
+            // load page, from swap or from the executable -- unless it
+            // is a code page already in memory for another thread running
+            // the same executable, then share it
+            bool readOnly = space->ro_bmp->Test(vpn);
+            int text = readOnly ? 
+                    machine->FindTextPage(space->TextSector(), vpn) : -1;
+            if (text == -1) {
+                space->ReadPage(vpn, &machine->mainMemory[ppn * PageSize]);
+                machine->InvalidateDecoded(ppn);
             }
-            // load page
-            machine->swapFiles[tid]->ReadAt(
-                &machine->mainMemory[ppn * PageSize],
-                PageSize, vpn * PageSize);
             // reset inverted page table
-            pg_entry->virtualPage = vpn;
-            pg_entry->valid = true;
-            pg_entry->readOnly = machine->ro_bmp[tid]->Test(vpn);
+            machine->MapPage(ppn, vpn);
+            machine->replacer->PageIn(sid, ppn);
+            pg_entry->readOnly = readOnly;
             pg_entry->use = false;
             pg_entry->dirty = false;
-            ASSERT(pg_entry->tid == tid);
+            ASSERT(pg_entry->sid == sid);
+            if (text != -1)
+                machine->ShareFrame(ppn, text);
+            else if (readOnly)
+                machine->AddTextPage(ppn, space->TextSector());
 
 #else 
             ASSERT(FALSE);
@@ -462,6 +436,30 @@ ExceptionHandler(ExceptionType which)
 
     } // PageFaultException
 
+//////////////////////////////////////////////
+// ReadOnlyException
+    else if (which == ReadOnlyException) {
+#ifdef INV_PG
+        // Unless the page holds only code, it is shared with another 
+        // addrspace since Fork (cf. Machine::ShareFrame): copy it now,
+        // and let the instruction write to the copy.
+        int virtAddr = machine->ReadRegister(BadVAddrReg);
+        unsigned int vpn = (unsigned) virtAddr / PageSize;
+        int ppn = machine->FindPage(currentThread->space->getSpaceID(), vpn);
+
+        ASSERT(ppn != -1);
+        if (currentThread->space->ro_bmp->Test(vpn)) {
+            printf("Write to read-only page %d!\n", vpn);
+            ASSERT(FALSE);
+        }
+        machine->UnshareFrame(ppn, TRUE);
+        machine->invPageTable[ppn].readOnly = FALSE;
+#else
+        printf("Write to read-only page!\n");
+        ASSERT(FALSE);
+#endif // INV_PG
+    } // ReadOnlyException
+
     else {
         printf("Unimplemented Exception!\n");
         ASSERT(FALSE);
@@ -0,0 +1,257 @@
+// pagerepl.cc
+//	Routines implementing the page replacement policies.
+//	See pagerepl.h for an overview.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "system.h"
+#include "pagerepl.h"
+
+#ifdef INV_PG
+
+//----------------------------------------------------------------------
+// NewPageReplacer
+// 	Create the page replacer for the policy called "name",
+//	or return NULL if there is none.
+//----------------------------------------------------------------------
+PageReplacer *
+NewPageReplacer(char *name)
+{
+    if (!strcmp(name, "lru"))
+		return new LRUReplacer();
+    if (!strcmp(name, "fifo"))
+		return new FIFOReplacer();
+    if (!strcmp(name, "clock"))
+		return new ClockPolicyReplacer();
+    if (!strcmp(name, "esc"))
+		return new SecondChanceReplacer();
+    if (!strcmp(name, "wsclock"))
+		return new WSClockReplacer();
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// LRUReplacer::LRUReplacer
+// 	No frame has been accessed yet.
+//----------------------------------------------------------------------
+LRUReplacer::LRUReplacer()
+{
+    now = 0;
+    for (int i = 0; i < NumPhysPages; i++)
+		stamp[i] = 0;
+}
+
+//----------------------------------------------------------------------
+// LRUReplacer::Victim
+// 	Return the valid frame of "sid" with the oldest access.
+//----------------------------------------------------------------------
+int
+LRUReplacer::Victim(int sid)
+{
+    int ppn, victim = -1;
+
+    for (ppn = machine->FirstResident(sid); ppn != -1;
+					ppn = machine->NextResident(ppn)) {
+		if (machine->invPageTable[ppn].valid &&
+				(victim == -1 || stamp[ppn] < stamp[victim]))
+			victim = ppn;
+    }
+    ASSERT(victim != -1);
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// ClockReplacer::ClockReplacer
+// 	All hands start at the first frame of the resident set; there is
+//	no hand yet, they are added by Hand.
+//----------------------------------------------------------------------
+ClockReplacer::ClockReplacer()
+{
+    hand = NULL;
+    numHands = 0;
+}
+
+//----------------------------------------------------------------------
+// ClockReplacer::Hand
+// 	Return the frame under the hand of "sid".  A hand left over by
+//	a previous space with the same sid is moved back to the start.
+//	The hands are doubled, until there is one for "sid".
+//----------------------------------------------------------------------
+int
+ClockReplacer::Hand(int sid)
+{
+    if (sid >= numHands) {
+		int i, newNum = max(2 * numHands, sid + 1), *newHand = new int[newNum];
+
+		for (i = 0; i < newNum; i++)
+			newHand[i] = (i < numHands) ? hand[i] : -1;
+		delete [] hand;
+		hand = newHand;
+		numHands = newNum;
+    }
+    if (hand[sid] == -1 || machine->invPageTable[hand[sid]].sid != sid)
+		hand[sid] = machine->FirstResident(sid);
+    return hand[sid];
+}
+
+//----------------------------------------------------------------------
+// ClockReplacer::Advance
+// 	Move the hand of "sid" to the next frame of its resident set,
+//	wrapping around at the end, and return that frame.
+//----------------------------------------------------------------------
+int
+ClockReplacer::Advance(int sid)
+{
+    int next = machine->NextResident(Hand(sid));
+
+    if (next == -1)
+		next = machine->FirstResident(sid);
+    hand[sid] = next;
+    return next;
+}
+
+//----------------------------------------------------------------------
+// ClockReplacer::CopyFrame
+// 	The hand of the child stops at the copy of the frame under the
+//	hand of the parent, so that they sweep in the same order.
+//----------------------------------------------------------------------
+void
+ClockReplacer::CopyFrame(int oldSid, int from, int newSid, int to)
+{
+    if (Hand(oldSid) == from) {
+		Hand(newSid);			// make sure it has a hand
+		hand[newSid] = to;
+    }
+}
+
+//----------------------------------------------------------------------
+// FIFOReplacer::Victim
+// 	Frames are filled in the order of the hand, so the frame under
+//	the hand is the oldest one.
+//----------------------------------------------------------------------
+int
+FIFOReplacer::Victim(int sid)
+{
+    int victim = Hand(sid);
+
+    Advance(sid);
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// ClockPolicyReplacer::Victim
+// 	Like FIFO, but a frame which was used since the hand last passed
+//	gets a second chance: clear its use bit and go on.
+//----------------------------------------------------------------------
+int
+ClockPolicyReplacer::Victim(int sid)
+{
+    TranslationEntry *entry;
+    int ppn;
+
+    for (ppn = Hand(sid); ; ppn = Advance(sid)) {
+		entry = &machine->invPageTable[ppn];
+		if (!entry->use)
+			break;
+		entry->use = FALSE;
+    }
+    Advance(sid);
+    return ppn;
+}
+
+//----------------------------------------------------------------------
+// SecondChanceReplacer::Victim
+// 	Sort the frames in four classes by their (use, dirty) bits, and
+//	replace the first frame of the lowest class found by the hand:
+//	   1. look for (0, 0), without changing anything;
+//	   2. look for (0, 1), clearing the use bits along the way;
+//	   3, 4. do it again: now every frame is (0, 0) or (0, 1).
+//	Replacing a clean page saves writing it to swap.
+//----------------------------------------------------------------------
+int
+SecondChanceReplacer::Victim(int sid)
+{
+    TranslationEntry *entry;
+    int ppn, pass, i, size = machine->ResidentSize(sid);
+
+    for (pass = 0; pass < 4; pass++) {
+		ppn = Hand(sid);
+		for (i = 0; i < size; i++, ppn = Advance(sid)) {
+			entry = &machine->invPageTable[ppn];
+			if (!entry->use && (entry->dirty == (pass % 2 == 1))) {
+				Advance(sid);
+				return ppn;
+			}
+			if (pass % 2 == 1)
+				entry->use = FALSE;
+		}
+    }
+    ASSERT(FALSE);	// pass 3 must have found a frame
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// WSClockReplacer::PageIn
+// 	A new page is in the working set.
+//----------------------------------------------------------------------
+void
+WSClockReplacer::PageIn(int sid, int ppn)
+{
+    lastUse[ppn] = stats->totalTicks;
+}
+
+//----------------------------------------------------------------------
+// WSClockReplacer::CopyFrame
+// 	The copy is in the working set of the child iff the original is
+//	in that of the parent.
+//----------------------------------------------------------------------
+void
+WSClockReplacer::CopyFrame(int oldSid, int from, int newSid, int to)
+{
+    lastUse[to] = lastUse[from];
+    ClockReplacer::CopyFrame(oldSid, from, newSid, to);
+}
+
+//----------------------------------------------------------------------
+// WSClockReplacer::Victim
+// 	Sweep the hand around the resident set once.  A frame whose use
+//	bit is set is in the working set: note the time and clear the bit.
+//	Otherwise, if it has not been used for WorkingSetWindow ticks it
+//	is outside the working set, and is replaced if it is clean.
+//
+//	There is no page cleaner to write dirty pages out in the
+//	background, so if only dirty frames are outside the working set,
+//	the first of them is replaced; if the whole resident set is in the
+//	working set, the least recently used frame is.
+//----------------------------------------------------------------------
+int
+WSClockReplacer::Victim(int sid)
+{
+    TranslationEntry *entry;
+    int ppn, i, oldDirty = -1, oldest = -1;
+    int size = machine->ResidentSize(sid), now = stats->totalTicks;
+
+    ppn = Hand(sid);
+    for (i = 0; i < size; i++, ppn = Advance(sid)) {
+		entry = &machine->invPageTable[ppn];
+		if (entry->use) {
+			entry->use = FALSE;
+			lastUse[ppn] = now;
+		} else if (now - lastUse[ppn] > WorkingSetWindow) {
+			if (!entry->dirty) {
+				Advance(sid);
+				return ppn;
+			}
+			if (oldDirty == -1)
+				oldDirty = ppn;
+		}
+		if (oldest == -1 || lastUse[ppn] < lastUse[oldest])
+			oldest = ppn;
+    }
+    return (oldDirty != -1) ? oldDirty : oldest;
+}
+
+#endif // INV_PG
@@ -0,0 +1,128 @@
+// pagerepl.h
+//	Data structures for choosing which page frame to replace, when
+//	an address space takes a page fault and all the page frames of 
+//	its resident set are in use (inverted page table only).  Resident
+//	sets are identified by sid (cf. Machine::AllocResidentSet).
+//
+//	Machine::FindReplEntry asks the page replacer to pick a victim.
+//	The replacer is also told when a page frame is (re)filled, when
+//	it is accessed, and when it is copied by fork, so that it can keep
+//	whatever bookkeeping it needs.  It may use and clear the "use"
+//	bits of invPageTable, but must not change anything else.
+//
+//	The policy is chosen when Nachos starts (cf. "-pr" in main.cc):
+//	    lru		least recently used (the default)
+//	    fifo	first in, first out
+//	    clock	FIFO, skipping pages used since the hand last passed
+//	    esc		enhanced second chance: like clock, but prefer
+//			clean pages, which need not be written to swap
+//	    wsclock	working set clock: prefer pages not used in the
+//			last WorkingSetWindow ticks, clean ones first
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef PAGEREPL_H
+#define PAGEREPL_H
+
+#include "copyright.h"
+#include "machine.h"
+
+#ifdef INV_PG
+
+#define WorkingSetWindow 2000	// (ticks) pages used more recently are in
+				// the working set of their space
+
+// The following class defines the interface of a page replacement
+// policy.  All the frames passed in are ppn's of invPageTable.
+
+class PageReplacer {
+  public:
+    virtual ~PageReplacer() {}
+
+    virtual const char *Name() = 0;	// the name used with "-pr"
+    virtual int Victim(int sid) = 0;	// choose a valid frame of the
+					// resident set of "sid" to replace
+    virtual void PageIn(int sid, int ppn) {}
+					// "ppn" now holds a new page of "sid"
+    virtual void Touch(int ppn) {}	// "ppn" is being accessed
+    virtual void CopyFrame(int oldSid, int from, int newSid, int to) {}
+					// fork copied page frame "from" of
+					// "oldSid" into "to" of "newSid"
+};
+
+// Return a new page replacer implementing the policy "name", or
+// NULL if there is no such policy.
+extern PageReplacer *NewPageReplacer(char *name);
+
+// Least recently used: every access stamps the frame with a counter,
+// the victim is the frame with the smallest stamp.
+
+class LRUReplacer : public PageReplacer {
+  public:
+    LRUReplacer();
+    const char *Name() { return "lru"; }
+    int Victim(int sid);
+    void PageIn(int sid, int ppn) { stamp[ppn] = ++now; }
+    void Touch(int ppn) { stamp[ppn] = ++now; }
+    void CopyFrame(int oldSid, int from, int newSid, int to)
+		{ stamp[to] = stamp[from]; }
+
+  private:
+    unsigned int now;			// # of accesses so far
+    unsigned int stamp[NumPhysPages];	// "now" at the last access
+};
+
+// The other policies sweep a "clock hand" around the resident set
+// of each space, in the order in which FindInvalidEntry hands out
+// its page frames -- which is also the order they are first filled.
+// The subclasses decide where the hand stops.
+
+class ClockReplacer : public PageReplacer {
+  public:
+    ClockReplacer();
+    ~ClockReplacer() { delete [] hand; }
+    void CopyFrame(int oldSid, int from, int newSid, int to);
+
+  protected:
+    int Hand(int sid);			// the frame under the hand of sid
+    int Advance(int sid);		// move the hand to the next frame
+					// of the resident set, return it
+    int *hand;			// per sid, -1 for the start
+    int numHands;		// # of sids in "hand"; it grows as
+				// higher sids show up
+};
+
+class FIFOReplacer : public ClockReplacer {
+  public:
+    const char *Name() { return "fifo"; }
+    int Victim(int sid);
+};
+
+class ClockPolicyReplacer : public ClockReplacer {
+  public:
+    const char *Name() { return "clock"; }
+    int Victim(int sid);
+};
+
+class SecondChanceReplacer : public ClockReplacer {
+  public:
+    const char *Name() { return "esc"; }
+    int Victim(int sid);
+};
+
+class WSClockReplacer : public ClockReplacer {
+  public:
+    const char *Name() { return "wsclock"; }
+    int Victim(int sid);
+    void PageIn(int sid, int ppn);
+    void CopyFrame(int oldSid, int from, int newSid, int to);
+
+  private:
+    int lastUse[NumPhysPages];		// time the use bit was last seen
+};
+
+#endif // INV_PG
+
+#endif // PAGEREPL_H
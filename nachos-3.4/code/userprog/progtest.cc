@@ -30,10 +30,14 @@ StartProcess(char *filename, char *currWorkDir)
         printf("Unable to open file \"%s\"\n", filename);
         return;
     }
-    space = new AddrSpace(executable, currentThread->getThreadID(), currWorkDir);
-    currentThread->space = space;
-
+    space = new AddrSpace(executable, currWorkDir);
     delete executable; // close file
+    if (!space->HasMemory()) {
+        printf("Not enough memory to run \"%s\"\n", filename);
+        delete space;
+        return;
+    }
+    currentThread->space = space;
 
     space->InitRegisters();		// set the initial register values
     space->RestoreState();		// load page table register
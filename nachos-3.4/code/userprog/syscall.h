@@ -55,7 +55,8 @@ void Exit(int status);
 typedef int SpaceId;	
  
 /* Run the executable, stored in the Nachos file "name", and return the 
- * address space identifier
+ * address space identifier, or -1 if it cannot be run (no such file, or
+ * not enough memory)
  */
 SpaceId Exec(char *name);
  
@@ -115,9 +116,10 @@ void Close(OpenFileId id);
  */
 
 /* Fork a thread to run a procedure ("func") in the *same* address space 
- * as the current thread.
+ * as the current thread.  Return 0, or -1 if there is not enough memory
+ * for the new thread.
  */
-void Fork(void (*func)());
+int Fork(void (*func)());
 
 /* Yield the CPU to another runnable thread, whether in this address space 
  * or not. 